@@ -0,0 +1,546 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ansi_backend.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "ansi_backend.h"
+#include "attr_line.h"
+#include "utf8.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+
+#include <algorithm>
+
+#define CSI                 "\x1b["
+#define SYNC_BEGIN          CSI "?2026h"
+#define SYNC_END            CSI "?2026l"
+
+// how long to wait for the rest of an escape sequence
+#define ESCAPE_TIMEOUT_MS   25
+
+// how long to wait for the terminal to answer queries
+#define QUERY_TIMEOUT_MS    200
+
+#define DEFAULT_ROWS        24
+#define DEFAULT_COLS        80
+
+static volatile sig_atomic_t bResized = 0;
+
+static void handle_winch(int sig)
+{
+    bResized = 1;
+}
+
+// SGR sequence selecting attr, starting from a reset.
+static std::string sgr(attr_t attr)
+{
+    std::string seq(CSI "0");
+    if (attr & A_BOLD) seq += ";1";
+    if (attr & A_UNDERLINE) seq += ";4";
+    if (attr & (A_REVERSE | A_STANDOUT)) seq += ";7";
+
+    int color = pairColor(PAIR_NUMBER(attr));
+    if (color >= 0) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), ";%d;49", 30 + color);
+        seq += buf;
+    }
+    return seq + "m";
+}
+
+static void moveTo(std::string& out, int row, int col)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), CSI "%d;%dH", row + 1, col + 1);
+    out += buf;
+}
+
+//
+// Public Methods
+//
+AnsiBackend::AnsiBackend(int _outFd, int _inFd) :
+    outFd(_outFd), inFd(_inFd), bTty(false), nRows(DEFAULT_ROWS), nCols(DEFAULT_COLS), bFrontValid(false), cursorRow(0), cursorCol(0), sentCursorRow(-1), sentCursorCol(-1), keyTimeoutMs(-1), bEof(false), bSync(false)
+{
+}
+
+bool AnsiBackend::init()
+{
+    bTty = (inFd >= 0 && isatty(inFd));
+    if (bTty) {
+        if (tcgetattr(inFd, &savedTermios) < 0) return false;
+
+        // the equivalent of curses' cbreak(), noecho() and nonl(). ISIG stays
+        // on so that Ctrl-C still raises SIGINT.
+        struct termios raw = savedTermios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_iflag &= ~(ICRNL | IXON);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        if (tcsetattr(inFd, TCSAFLUSH, &raw) < 0) return false;
+
+        // no SA_RESTART, so that a resize interrupts a blocked read
+        struct sigaction sa;
+        sa.sa_handler = handle_winch;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = 0;
+        sigaction(SIGWINCH, &sa, NULL);
+
+        bSync = querySync();
+    }
+
+    updateSize();
+
+    // alternate screen, cleared
+    write(CSI "?1049h" CSI "0m" CSI "2J");
+    bFrontValid = false;
+    return true;
+}
+
+void AnsiBackend::shutdown()
+{
+    write(CSI "0m" CSI "?1049l");
+    if (bTty) {
+        tcsetattr(inFd, TCSAFLUSH, &savedTermios);
+        signal(SIGWINCH, SIG_DFL);
+    }
+}
+
+void AnsiBackend::clear()
+{
+    const cell blank = blankCell();
+    back.assign(back.size(), blank);
+}
+
+void AnsiBackend::clearToEol(int row, int col)
+{
+    if (row < 0 || row >= nRows || col < 0 || col >= nCols) return;
+
+    const cell blank = blankCell();
+    if (col > 0 && back[row * nCols + col].length == 0) back[row * nCols + col - 1] = blank;
+    std::fill(back.begin() + row * nCols + col, back.begin() + (row + 1) * nCols, blank);
+}
+
+void AnsiBackend::putText(int row, int col, const char* text, size_t length, attr_t attr)
+{
+    if (row < 0 || row >= nRows || col >= nCols) return;
+
+    bool bAscii = isAscii(text, length);
+    size_t pos = 0;
+    while (pos < length && col < nCols) {
+        size_t end = pos + 1;
+        int width = 1;
+        if (!bAscii) end = nextCluster(text, length, pos, width);
+
+        // zero width characters with nothing before them are dropped
+        if (width > 0 && col >= 0) {
+            if (col + width > nCols) break;
+            setCell(row, col, text + pos, end - pos, width, attr);
+        }
+        col += width;
+        pos = end;
+    }
+}
+
+void AnsiBackend::setHighlight(int row, int col, bool bOn)
+{
+    if (row < 0 || row >= nRows || col < 0 || col >= nCols) return;
+
+    if (col > 0 && back[row * nCols + col].length == 0) col--;
+    cell& c = back[row * nCols + col];
+    if (bOn) {
+        c.attr |= A_STANDOUT;
+    }
+    else {
+        c.attr &= ~A_STANDOUT;
+    }
+}
+
+void AnsiBackend::moveCursor(int row, int col)
+{
+    cursorRow = row;
+    cursorCol = col;
+}
+
+void AnsiBackend::flush()
+{
+    std::string out;
+    if (bSync) out += SYNC_BEGIN;
+    size_t start = out.size();
+
+    const cell blank = blankCell();
+    if (!bFrontValid) {
+        out += CSI "0m" CSI "2J";
+        front.assign(back.size(), blank);
+        bFrontValid = true;
+    }
+    else {
+        out += pendingScrolls;
+    }
+    pendingScrolls.clear();
+
+    // where the terminal's cursor is and which attributes are set, if known
+    int row = -1;
+    int col = -1;
+    attr_t attr = A_NORMAL;
+    bool bAttrKnown = false;
+    bool bChanged = false;
+
+    for (int r = 0; r < nRows; r++) {
+        // past the last non-blank cell, erasing to the end of the row is
+        // cheaper than writing spaces
+        int blankFrom = nCols;
+        while (blankFrom > 0 && back[r * nCols + blankFrom - 1] == blank) blankFrom--;
+
+        for (int c = 0; c < nCols; c++) {
+            size_t i = r * nCols + c;
+            if (back[i] == front[i]) continue;
+
+            // drawn along with the left half
+            if (back[i].length == 0) {
+                front[i] = back[i];
+                continue;
+            }
+
+            if (c >= blankFrom) {
+                if (r != row || c != col) moveTo(out, r, c);
+                if (!bAttrKnown || attr != A_NORMAL) {
+                    attr = A_NORMAL;
+                    bAttrKnown = true;
+                    out += CSI "0m";
+                }
+                out += CSI "K";
+                std::fill(front.begin() + i, front.begin() + (r + 1) * nCols, blank);
+                bChanged = true;
+                row = r;
+                col = c;
+                break;
+            }
+
+            if (r != row || c != col) moveTo(out, r, c);
+            if (!bAttrKnown || back[i].attr != attr) {
+                attr = back[i].attr;
+                bAttrKnown = true;
+                out += sgr(attr);
+            }
+            out.append(back[i].text, back[i].length);
+            front[i] = back[i];
+            bChanged = true;
+
+            // writing the last column leaves the cursor in limbo
+            row = r;
+            col = (c + back[i].width < nCols) ? c + back[i].width : -1;
+        }
+    }
+
+    if (!bChanged && out.size() == start &&
+        cursorRow == sentCursorRow && cursorCol == sentCursorCol) return;
+
+    if (bAttrKnown) out += CSI "0m";
+    moveTo(out, cursorRow, cursorCol);
+    sentCursorRow = cursorRow;
+    sentCursorCol = cursorCol;
+    if (bSync) out += SYNC_END;
+    write(out);
+}
+
+// The front buffer is scrolled along with the terminal so that flush() only
+// sends the rows scrolled in.
+void AnsiBackend::scrollRegion(int top, int bottom, int n)
+{
+    if (top < 0) top = 0;
+    if (bottom >= nRows) bottom = nRows - 1;
+    if (top > bottom || n == 0) return;
+
+    scrollCells(back, nCols, top, bottom, n);
+    if (!bFrontValid) return;
+
+    scrollCells(front, nCols, top, bottom, n);
+
+    // set the region, scroll it with SU/SD and reset it. Resetting the region
+    // homes the cursor.
+    char buf[64];
+    snprintf(buf, sizeof(buf), CSI "0m" CSI "%d;%dr" CSI "%d%c" CSI "r", top + 1, bottom + 1, abs(n), n > 0 ? 'S' : 'T');
+    pendingScrolls += buf;
+    sentCursorRow = -1;
+}
+
+int AnsiBackend::getKey()
+{
+    flush();
+
+    while (true) {
+        if (bResized) {
+            bResized = 0;
+            updateSize();
+            return KEY_RESIZE;
+        }
+
+        if (!inBuf.empty()) return decodeKey();
+        if (bEof) return KEY_EOF;
+
+        // timed out, or interrupted by anything other than a resize
+        if (!readInput(keyTimeoutMs) && !bResized && !bEof) return ERR;
+    }
+}
+
+void AnsiBackend::setKeyTimeout(int ms)
+{
+    keyTimeoutMs = ms;
+}
+
+void AnsiBackend::resize(int rows, int cols)
+{
+    nRows = rows;
+    nCols = cols;
+
+    const cell blank = blankCell();
+    back.assign(nRows * nCols, blank);
+    bFrontValid = false;
+    sentCursorRow = -1;
+}
+
+//
+// Private Methods
+//
+AnsiBackend::cell AnsiBackend::blankCell()
+{
+    cell blank;
+    blank.text[0] = ' ';
+    blank.length = 1;
+    blank.width = 1;
+    blank.attr = A_NORMAL;
+    return blank;
+}
+
+// Writes a character cluster, blanking what is left of any wide character it
+// overwrites half of.
+void AnsiBackend::setCell(int row, int col, const char* text, size_t length, int width, attr_t attr)
+{
+    const cell blank = blankCell();
+    cell* cells = &back[row * nCols];
+
+    int end = col + width;
+    if (cells[col].length == 0 && col > 0) cells[col - 1] = blank;
+    if (cells[end - 1].width == 2 && end < nCols) cells[end] = blank;
+
+    // keep whole characters when a cluster has too many combining marks
+    if (length > CELL_BYTES) {
+        size_t keep = 0;
+        while (keep < length) {
+            size_t n = utf8SequenceLength(text[keep]);
+            if (n == 0) n = 1;
+            if (keep + n > CELL_BYTES) break;
+            keep += n;
+        }
+        length = keep;
+    }
+
+    cell& c = cells[col];
+    memcpy(c.text, text, length);
+    c.length = length;
+    c.width = width;
+    c.attr = attr;
+
+    if (width == 2) {
+        cell& right = cells[col + 1];
+        right.length = 0;
+        right.width = 0;
+        right.attr = attr;
+    }
+}
+
+void AnsiBackend::scrollCells(std::vector<cell>& cells, int cols, int top, int bottom, int n)
+{
+    const cell blank = blankCell();
+    std::vector<cell>::iterator first = cells.begin() + top * cols;
+    std::vector<cell>::iterator last = cells.begin() + (bottom + 1) * cols;
+    int rows = bottom - top + 1;
+
+    if (abs(n) >= rows) {
+        std::fill(first, last, blank);
+    }
+    else if (n > 0) {
+        std::copy(first + n * cols, last, first);
+        std::fill(last - n * cols, last, blank);
+    }
+    else {
+        std::copy_backward(first, last + n * cols, last);
+        std::fill(first, first - n * cols, blank);
+    }
+}
+
+void AnsiBackend::updateSize()
+{
+    int rows = DEFAULT_ROWS;
+    int cols = DEFAULT_COLS;
+
+    struct winsize ws;
+    if (ioctl(outFd, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        rows = ws.ws_row;
+        cols = ws.ws_col;
+    }
+    else {
+        const char* env = getenv("LINES");
+        if (env && atoi(env) > 0) rows = atoi(env);
+        env = getenv("COLUMNS");
+        if (env && atoi(env) > 0) cols = atoi(env);
+    }
+    resize(rows, cols);
+}
+
+// Waits up to timeoutMs (forever if negative) for input. Returns false on
+// timeout, end of input or a signal.
+bool AnsiBackend::readInput(int timeoutMs)
+{
+    if (inFd < 0) return false;
+
+    struct pollfd pfd;
+    pfd.fd = inFd;
+    pfd.events = POLLIN;
+    if (bEof || poll(&pfd, 1, timeoutMs) <= 0) return false;
+
+    char buf[256];
+    ssize_t n = read(inFd, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return false;
+    if (n <= 0) {
+        // closed, or hung up - reading again would return at once
+        bEof = true;
+        return false;
+    }
+    inBuf.append(buf, n);
+    return true;
+}
+
+// Asks whether the terminal knows synchronized updates (DEC mode 2026) with
+// DECRQM. Terminals that do not know DECRQM ignore it, so primary device
+// attributes are asked for too. Every terminal answers that, and last. Keys
+// typed meanwhile are left in the input buffer.
+bool AnsiBackend::querySync()
+{
+    write(CSI "?2026$p" CSI "c");
+
+    size_t end;
+    while (findReply(inBuf, "c", end) == std::string::npos) {
+        if (!readInput(QUERY_TIMEOUT_MS)) break;
+    }
+
+    // CSI ? 2026 ; Ps $ y, Ps being 0 or 4 when the mode cannot be set
+    bool bSupported = false;
+    size_t pos = findReply(inBuf, "$y", end);
+    if (pos != std::string::npos) {
+        if (inBuf.compare(pos + 3, 5, "2026;") == 0) {
+            int state = atoi(inBuf.c_str() + pos + 8);
+            bSupported = (state >= 1 && state <= 3);
+        }
+        inBuf.erase(pos, end + 2 - pos);
+    }
+
+    pos = findReply(inBuf, "c", end);
+    if (pos != std::string::npos) inBuf.erase(pos, end + 1 - pos);
+    return bSupported;
+}
+
+// Finds a complete CSI ? <digits and semicolons> <final> in buf. Returns its
+// start and sets end to where final starts.
+size_t AnsiBackend::findReply(const std::string& buf, const char* final, size_t& end)
+{
+    size_t pos = buf.find(CSI "?");
+    while (pos != std::string::npos) {
+        end = buf.find_first_not_of("0123456789;", pos + 3);
+        if (end == std::string::npos) break;
+        if (buf.compare(end, strlen(final), final) == 0) return pos;
+        pos = buf.find(CSI "?", end);
+    }
+    return std::string::npos;
+}
+
+// Removes one key from the input buffer, which must not be empty.
+int AnsiBackend::decodeKey()
+{
+    unsigned char c = inBuf[0];
+    if (c != 0x1b) {
+        inBuf.erase(0, 1);
+        if (c == 127 || c == 8) return KEY_BACKSPACE;
+        return c;
+    }
+
+    // a lone escape, or the start of a sequence?
+    if (inBuf.size() == 1 && !readInput(ESCAPE_TIMEOUT_MS)) {
+        inBuf.erase(0, 1);
+        return c;
+    }
+    if (inBuf[1] != '[' && inBuf[1] != 'O') {
+        inBuf.erase(0, 1);
+        return c;
+    }
+
+    // parameters, then a final byte in 0x40 - 0x7e
+    size_t end = 2;
+    while (true) {
+        while (end < inBuf.size() && (inBuf[end] < 0x40 || inBuf[end] > 0x7e)) end++;
+        if (end < inBuf.size()) break;
+        if (!readInput(ESCAPE_TIMEOUT_MS)) {
+            inBuf.clear();
+            return ERR;
+        }
+    }
+
+    char final = inBuf[end];
+    int param = atoi(inBuf.substr(2, end - 2).c_str());
+    inBuf.erase(0, end + 1);
+
+    switch (final) {
+    case 'A': return KEY_UP;
+    case 'B': return KEY_DOWN;
+    case 'C': return KEY_RIGHT;
+    case 'D': return KEY_LEFT;
+    case 'H': return KEY_HOME;
+    case 'F': return KEY_END;
+    case '~':
+        switch (param) {
+        case 1: case 7: return KEY_HOME;
+        case 2:         return KEY_IC;
+        case 3:         return KEY_DC;
+        case 4: case 8: return KEY_END;
+        case 5:         return KEY_PPAGE;
+        case 6:         return KEY_NPAGE;
+        }
+    }
+    return ERR;
+}
+
+void AnsiBackend::write(const std::string& data)
+{
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(outFd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        written += n;
+    }
+}
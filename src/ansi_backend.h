@@ -0,0 +1,122 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// ansi_backend.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _ANSI_BACKEND__H_
+#define _ANSI_BACKEND__H_
+
+#include "terminal_backend.h"
+
+#include <termios.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// bytes kept per cell: a character and a few combining marks
+#define CELL_BYTES  16
+
+// Talks VT100/ANSI escape sequences directly instead of going through
+// terminfo. Drawing goes to a back buffer of cells. flush() compares it with
+// a front buffer holding what the terminal shows and sends only the cells
+// that differ, as one write, inside a synchronized update where the terminal
+// supports those. Text is UTF-8. A wide character takes two cells, the second
+// of which is left empty.
+class AnsiBackend : public TerminalBackend
+{
+private:
+    struct cell
+    {
+        char text[CELL_BYTES]; // not terminated
+        unsigned char length; // 0 for the right half of a wide character
+        unsigned char width;
+        attr_t attr;
+
+        bool operator==(const cell& other) const
+        {
+            return length == other.length && width == other.width && attr == other.attr &&
+                   memcmp(text, other.text, length) == 0;
+        }
+        bool operator!=(const cell& other) const { return !(*this == other); }
+    };
+
+    int outFd;
+    int inFd;
+    bool bTty;
+    struct termios savedTermios;
+
+    int nRows;
+    int nCols;
+    std::vector<cell> front;
+    std::vector<cell> back;
+    bool bFrontValid;
+
+    // scrolls not yet sent, which happen before the cell updates
+    std::string pendingScrolls;
+
+    int cursorRow;
+    int cursorCol;
+    int sentCursorRow;
+    int sentCursorCol;
+
+    std::string inBuf;
+    int keyTimeoutMs;
+    bool bEof;
+
+    // whether updates are wrapped in DEC 2026 synchronized update markers
+    bool bSync;
+
+    static cell blankCell();
+    void setCell(int row, int col, const char* text, size_t length, int width, attr_t attr);
+    static void scrollCells(std::vector<cell>& cells, int cols, int top, int bottom, int n);
+    void updateSize();
+    bool readInput(int timeoutMs);
+    bool querySync();
+    static size_t findReply(const std::string& buf, const char* final, size_t& end);
+    int decodeKey();
+    void write(const std::string& data);
+
+public:
+    // With no descriptors given, the backend runs on stdin and stdout.
+    AnsiBackend(int _outFd = 1, int _inFd = 0);
+
+    bool init();
+    void shutdown();
+
+    int rows() const { return nRows; }
+    int cols() const { return nCols; }
+
+    void clear();
+    void clearToEol(int row, int col);
+    void putText(int row, int col, const char* text, size_t length, attr_t attr);
+    void setHighlight(int row, int col, bool bOn);
+    void moveCursor(int row, int col);
+    void flush();
+    void scrollRegion(int top, int bottom, int n);
+
+    int getKey();
+    void setKeyTimeout(int ms);
+    void resize(int rows, int cols);
+};
+
+#endif // _ANSI_BACKEND__H_
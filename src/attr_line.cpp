@@ -0,0 +1,225 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// attr_line.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "attr_line.h"
+#include "utf8.h"
+
+#include <stdlib.h>
+
+#define ESC     '\x1b'
+
+int colorPair(int color)
+{
+    switch (color) {
+    case COLOR_RED:     return PAIR_RED;
+    case COLOR_GREEN:   return PAIR_GREEN;
+    case COLOR_YELLOW:  return PAIR_YELLOW;
+    case COLOR_BLUE:    return PAIR_BLUE;
+    case COLOR_CYAN:    return PAIR_CYAN;
+    case COLOR_MAGENTA: return PAIR_MAGENTA;
+    case COLOR_WHITE:   return PAIR_WHITE;
+    default:            return 0;
+    }
+}
+
+int pairColor(int pair)
+{
+    switch (pair) {
+    case PAIR_RED:      return COLOR_RED;
+    case PAIR_GREEN:    return COLOR_GREEN;
+    case PAIR_YELLOW:   return COLOR_YELLOW;
+    case PAIR_BLUE:     return COLOR_BLUE;
+    case PAIR_CYAN:     return COLOR_CYAN;
+    case PAIR_MAGENTA:  return COLOR_MAGENTA;
+    case PAIR_WHITE:    return COLOR_WHITE;
+    default:            return -1;
+    }
+}
+
+// Returns the length of the SGR escape starting at pos, or 0 if there is none.
+static size_t escapeLength(const std::string& text, size_t pos)
+{
+    if (text[pos] != ESC || pos + 1 >= text.size() || text[pos + 1] != '[') return 0;
+
+    size_t end = pos + 2;
+    while (end < text.size() && ((text[end] >= '0' && text[end] <= '9') || text[end] == ';')) end++;
+    if (end == text.size() || text[end] != 'm') return 0;
+    return end + 1 - pos;
+}
+
+// Applies the parameters of an SGR escape to attr.
+static attr_t applyEscape(const std::string& escape, attr_t attr, attr_t baseAttr)
+{
+    // strip ESC [ and the trailing m
+    std::string params = escape.substr(2, escape.size() - 3);
+    if (params.empty()) return baseAttr;
+
+    size_t pos = 0;
+    while (pos <= params.size()) {
+        size_t end = params.find(';', pos);
+        if (end == std::string::npos) end = params.size();
+        if (end == pos) {
+            // an empty field, as in ESC[1;m, is not a reset
+            pos = end + 1;
+            continue;
+        }
+        int code = atoi(params.substr(pos, end - pos).c_str());
+        pos = end + 1;
+
+        if (code == 0) {
+            attr = baseAttr;
+        }
+        else if (code == 1) {
+            attr |= A_BOLD;
+        }
+        else if (code == 4) {
+            attr |= A_UNDERLINE;
+        }
+        else if (code == 7) {
+            attr |= A_REVERSE;
+        }
+        else if (code >= 30 && code <= 37) {
+            attr = (attr & ~A_COLOR) | COLOR_PAIR(colorPair(code - 30));
+        }
+        else if (code == 39) {
+            attr = (attr & ~A_COLOR) | (baseAttr & A_COLOR);
+        }
+    }
+    return attr;
+}
+
+AttrLine& AttrLine::append(const std::string& text, attr_t attr)
+{
+    if (text.empty()) return *this;
+
+    if (!lineSpans.empty() && lineSpans.back().attr == attr) {
+        lineSpans.back().length += text.size();
+    }
+    else {
+        attr_span span;
+        span.start = lineText.size();
+        span.length = text.size();
+        span.attr = attr;
+        lineSpans.push_back(span);
+    }
+    lineText += text;
+
+    if (::isAscii(text.c_str(), text.size())) {
+        nCols += text.size();
+    }
+    else {
+        nCols += displayWidth(text.c_str(), text.size());
+        bAscii = false;
+    }
+    return *this;
+}
+
+bool AttrLine::operator==(const AttrLine& other) const
+{
+    if (lineText != other.lineText || lineSpans.size() != other.lineSpans.size()) return false;
+
+    for (unsigned int i = 0; i < lineSpans.size(); i++) {
+        if (lineSpans[i].start != other.lineSpans[i].start ||
+            lineSpans[i].length != other.lineSpans[i].length ||
+            lineSpans[i].attr != other.lineSpans[i].attr) return false;
+    }
+    return true;
+}
+
+std::vector<AttrLine> AttrLine::parse(const std::string& text, attr_t baseAttr)
+{
+    std::vector<AttrLine> lines(1);
+    attr_t attr = baseAttr;
+
+    size_t runStart = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t n = (text[pos] == ESC) ? escapeLength(text, pos) : 0;
+        if (n == 0 && text[pos] != '\n') {
+            pos++;
+            continue;
+        }
+
+        lines.back().append(text.substr(runStart, pos - runStart), attr);
+        if (n > 0) {
+            attr = applyEscape(text.substr(pos, n), attr, baseAttr);
+            pos += n;
+        }
+        else {
+            lines.push_back(AttrLine());
+            pos++;
+        }
+        runStart = pos;
+    }
+    lines.back().append(text.substr(runStart), attr);
+
+    // like std::getline, a trailing newline does not start another line
+    if (lines.size() > 1 && text[text.size() - 1] == '\n') lines.pop_back();
+    return lines;
+}
+
+std::string stripEscapes(const std::string& text)
+{
+    if (text.find(ESC) == std::string::npos) return text;
+
+    std::string stripped;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t n = escapeLength(text, pos);
+        if (n > 0) {
+            pos += n;
+        }
+        else {
+            stripped += text[pos++];
+        }
+    }
+    return stripped;
+}
+
+void block_codec<AttrLine>::encode(const AttrLine& line, std::string& out)
+{
+    block_codec<std::string>::encode(line.text(), out);
+    block_codec<std::string>::putUint32(out, line.spans().size());
+    for (unsigned int i = 0; i < line.spans().size(); i++) {
+        const attr_span& span = line.spans()[i];
+        block_codec<std::string>::putUint32(out, span.start);
+        block_codec<std::string>::putUint32(out, span.length);
+        block_codec<std::string>::putUint32(out, span.attr);
+    }
+}
+
+AttrLine block_codec<AttrLine>::decode(const char*& pos, const char* end)
+{
+    std::string text = block_codec<std::string>::decode(pos, end);
+    AttrLine line;
+    uint32_t nSpans = block_codec<std::string>::getUint32(pos, end);
+    for (uint32_t i = 0; i < nSpans; i++) {
+        uint32_t start = block_codec<std::string>::getUint32(pos, end);
+        uint32_t length = block_codec<std::string>::getUint32(pos, end);
+        attr_t attr = block_codec<std::string>::getUint32(pos, end);
+        if (start > text.size() || length > text.size() - start) throw std::runtime_error("Corrupt compressed block.");
+        line.append(text.substr(start, length), attr);
+    }
+    return line;
+}
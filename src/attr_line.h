@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// attr_line.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _ATTR_LINE__H_
+#define _ATTR_LINE__H_
+
+#include "compressed_vector.h"
+
+#include <string>
+#include <vector>
+
+#include <curses.h>
+
+// Color pairs set up by the interpreter.
+enum {
+    PAIR_RED = 1,
+    PAIR_GREEN,
+    PAIR_YELLOW,
+    PAIR_BLUE,
+    PAIR_CYAN,
+    PAIR_MAGENTA,
+    PAIR_WHITE
+};
+
+// Maps a curses COLOR_* constant to the color pair that draws it.
+int colorPair(int color);
+
+// The inverse: the COLOR_* constant a pair draws, or -1 for the default pair.
+int pairColor(int pair);
+
+struct attr_span
+{
+    unsigned int start;
+    unsigned int length;
+    attr_t attr;
+};
+
+// A line of text together with its attribute runs, resolved once when the
+// line is added so that repainting needs no further parsing. The text is
+// UTF-8. Its display width is kept up to date as text is appended, so
+// wrapping never has to measure it again.
+class AttrLine
+{
+private:
+    std::string lineText;
+    std::vector<attr_span> lineSpans;
+    size_t nCols;
+    bool bAscii;
+
+public:
+    AttrLine() : nCols(0), bAscii(true) { }
+    explicit AttrLine(const std::string& text, attr_t attr = A_NORMAL) : nCols(0), bAscii(true) { append(text, attr); }
+
+    AttrLine& append(const std::string& text, attr_t attr);
+
+    const std::string& text() const { return lineText; }
+    const std::vector<attr_span>& spans() const { return lineSpans; }
+    size_t width() const { return nCols; }
+    bool operator==(const AttrLine& other) const;
+    bool operator!=(const AttrLine& other) const { return !(*this == other); }
+    bool isAscii() const { return bAscii; } // one byte per column
+
+    // Splits text into lines, turning ANSI SGR color escapes into attribute
+    // runs. Text outside any escape is drawn with baseAttr. Attributes carry
+    // over line breaks.
+    static std::vector<AttrLine> parse(const std::string& text, attr_t baseAttr);
+};
+
+// Stores a line as its text followed by its spans, for compressed scrollback.
+template <>
+struct block_codec<AttrLine>
+{
+    static void encode(const AttrLine& line, std::string& out);
+    static AttrLine decode(const char*& pos, const char* end);
+};
+
+// Removes ANSI SGR escapes from text.
+std::string stripEscapes(const std::string& text);
+
+#endif // _ATTR_LINE__H_
@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// cancel_token.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _CANCEL_TOKEN__H_
+#define _CANCEL_TOKEN__H_
+
+#include <signal.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+// Cooperative cancellation handle. Copies share the same state, so the
+// interpreter can cancel a token that a command is polling on another
+// thread. A child token is cancelled whenever its parent is.
+class CancelToken
+{
+public:
+    typedef std::chrono::steady_clock clock_t;
+
+    CancelToken() : state(new State()) { }
+
+    CancelToken child() const
+    {
+        CancelToken token;
+        token.state->parent = state;
+        return token;
+    }
+
+    void cancel() const { state->bCancelled = true; }
+
+    // True for copies of the same token.
+    bool operator==(const CancelToken& other) const { return state == other.state; }
+
+    // A timeout of 0 ms means no deadline. Must be set before the token is
+    // handed to another thread.
+    void setTimeout(unsigned long ms) const
+    {
+        state->timeoutMs = ms;
+        state->deadline = clock_t::now() + std::chrono::milliseconds(ms);
+    }
+
+    // Cancels the token once *flag is seen set, so that a signal handler can
+    // cancel it by setting the flag. Must be set before the token is handed
+    // to another thread.
+    void setInterruptFlag(const volatile sig_atomic_t* flag) const { state->pInterrupt = flag; }
+
+    bool isTimedOut() const
+    {
+        for (const State* s = state.get(); s; s = s->parent.get()) {
+            if (s->timeoutMs > 0 && clock_t::now() >= s->deadline) return true;
+        }
+        return false;
+    }
+
+    bool isCancelled() const
+    {
+        for (State* s = state.get(); s; s = s->parent.get()) {
+            // latched, as the flag is cleared again for the next command
+            if (s->pInterrupt && *s->pInterrupt) s->bCancelled = true;
+            if (s->bCancelled) return true;
+        }
+        return isTimedOut();
+    }
+
+    // Throws if the token has been cancelled or its deadline has passed.
+    void check() const
+    {
+        for (const State* s = state.get(); s; s = s->parent.get()) {
+            if (s->timeoutMs > 0 && clock_t::now() >= s->deadline) {
+                std::stringstream err;
+                err << "Timed out after " << s->timeoutMs << " ms.";
+                throw std::runtime_error(err.str());
+            }
+        }
+        if (isCancelled()) throw std::runtime_error("Cancelled.");
+    }
+
+private:
+    struct State
+    {
+        State() : bCancelled(false), pInterrupt(NULL), timeoutMs(0) { }
+
+        std::atomic<bool> bCancelled;
+        const volatile sig_atomic_t* pInterrupt;
+        unsigned long timeoutMs;
+        clock_t::time_point deadline;
+        std::shared_ptr<State> parent;
+    };
+
+    std::shared_ptr<State> state;
+};
+
+#endif // _CANCEL_TOKEN__H_
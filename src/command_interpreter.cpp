@@ -24,9 +24,22 @@
 
 #include "command_interpreter.h"
 #include "console_session.h"
+#include "job_manager.h"
+#include "machine_session.h"
+#include "module_loader.h"
+#include "key_recorder.h"
+#include "watcher.h"
+#include "curses_backend.h"
+#include "ansi_backend.h"
 
 #include <curses.h>
 #include <signal.h>
+#include <locale.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 
 #include <iostream>
 #include <map>
@@ -34,14 +47,60 @@
 #include <algorithm>
 #include <iterator>
 #include <stdexcept>
+#include <functional>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <atomic>
 
-typedef std::map<std::string, fAction>  command_map_t;
+// How often the interpreter checks for Ctrl-C and deadlines while a command runs.
+#define COMMAND_POLL_MS     50
+
+typedef std::function<result_t(bool, const params_t&, const CancelToken&)> command_t;
+typedef std::map<std::string, command_t>  command_map_t;
 command_map_t command_map;
+std::map<std::string, int> command_flags;
+
+// Guards command_map, which grows whenever a module is loaded. Recursive
+// since modules register their commands while a lookup holds it.
+std::recursive_mutex command_mutex;
+ModuleLoader modules;
 
 std::vector<std::string> input_history;
-std::vector<std::string> output_history;
+compressed_vector<std::string> output_history;
 
 ConsoleSession cs("> ");
+JobManager jobs;
+Watcher watcher;
+SessionSnapshot snapshot;
+
+// Deadline applied to every command entered at the prompt. 0 means none.
+std::atomic<unsigned long> defaultTimeoutMs(0); // set by deadline, which may run on any thread
+
+// Set by SIGINT, cleared before each command entered at the prompt. Only
+// that command's token watches it.
+static volatile sig_atomic_t bInterrupted = 0;
+
+// Set by SIGTERM.
+static volatile sig_atomic_t bTerminated = 0;
+
+command_t findCommand(const std::string& command);
+int commandFlags(const std::string& command);
+bool isHelpRequest(const params_t& params);
+result_t runCancellable(const command_t& cmd, bool bHelp, const params_t& params, const CancelToken& token);
+
+///////////////////////////////////
+//
+// Output Formatting
+//
+std::string colorSpan(const std::string& text, int color, bool bBold)
+{
+    std::stringstream out;
+    out << "\x1b[" << (bBold ? "1;" : "") << (30 + color) << "m" << text << "\x1b[0m";
+    return out.str();
+}
 
 ///////////////////////////////////
 //
@@ -56,22 +115,23 @@ result_t console_help(bool bHelp, const params_t& params)
 
     std::stringstream out;
     if (params.size() == 0) {
+        std::lock_guard<std::recursive_mutex> lock(command_mutex);
         out << "List of commands:";
         command_map_t::iterator it = command_map.begin();
         for (; it != command_map.end(); ++it) {
-            out << std::endl << it->second(true, params);
+            out << std::endl << it->second(true, params, CancelToken());
+        }
+
+        // don't load modules just to list them
+        std::vector<std::string> pending = modules.pendingCommands();
+        for (uint i = 0; i < pending.size(); i++) {
+            out << std::endl << pending[i] << " - (from " << modules.moduleFor(pending[i]) << ")";
         }
         out << std::endl << "exit - exit application.";
         return out.str();
     }
     else {
-        command_map_t::iterator it = command_map.find(params[0]);
-        if (it == command_map.end()) {
-            std::stringstream err;
-            err << "Invalid command " << params[0] << ".";
-            throw std::runtime_error(err.str());
-        }
-        return it->second(true, params);
+        return findCommand(params[0])(true, params, CancelToken());
     }
 }
 
@@ -89,20 +149,281 @@ result_t console_echo(bool bHelp, const params_t& params)
     return result;
 }
 
+///////////////////////////////////
+//
+// Job Control Functions
+//
+unsigned int parseJobId(const std::string& text)
+{
+    std::string id = text;
+    if (id.size() > 0 && id[0] == '%') id = id.substr(1);
+
+    char* end;
+    unsigned long n = strtoul(id.c_str(), &end, 10);
+    if (id.empty() || *end != '\0' || n == 0) {
+        std::stringstream err;
+        err << "Invalid job id " << text << ".";
+        throw std::runtime_error(err.str());
+    }
+    return n;
+}
+
+result_t console_jobs(bool bHelp, const params_t& params)
+{
+    if (bHelp || params.size() > 0) {
+        return "jobs - lists background jobs.";
+    }
+
+    std::vector<Job> list = jobs.list();
+    if (list.empty()) return "No jobs.";
+
+    std::stringstream out;
+    for (uint i = 0; i < list.size(); i++) {
+        if (i > 0) out << std::endl;
+        out << "[" << list[i].id << "] ";
+        switch (list[i].state) {
+        case JOB_RUNNING:   out << "Running "; break;
+        case JOB_DONE:      out << "Done    "; break;
+        case JOB_FAILED:    out << "Failed  "; break;
+        case JOB_KILLED:    out << "Killed  "; break;
+        }
+        out << list[i].description;
+    }
+    return out.str();
+}
+
+result_t console_wait(bool bHelp, const params_t& params, const CancelToken& token)
+{
+    if (bHelp) {
+        return "wait [<job id> ...] - waits for the given background jobs, or for all of them. Job ids are given as %N or N.";
+    }
+
+    if (params.size() == 0) {
+        jobs.waitAll(token);
+        return "All jobs finished.";
+    }
+
+    for (uint i = 0; i < params.size(); i++) {
+        if (!jobs.wait(parseJobId(params[i]), token)) {
+            std::stringstream err;
+            err << "No such job " << params[i] << ".";
+            throw std::runtime_error(err.str());
+        }
+    }
+    return "Jobs finished.";
+}
+
+result_t console_kill(bool bHelp, const params_t& params)
+{
+    if (bHelp || params.size() == 0) {
+        return "kill <job id> [<job id> ...] - kills background jobs. Job ids are given as %N or N.";
+    }
+
+    for (uint i = 0; i < params.size(); i++) {
+        if (!jobs.kill(parseJobId(params[i]))) {
+            std::stringstream err;
+            err << "No such job " << params[i] << ".";
+            throw std::runtime_error(err.str());
+        }
+    }
+    return "Killed.";
+}
+
+result_t console_parallel(bool bHelp, const params_t& params, const CancelToken& token)
+{
+    if (bHelp || params.size() < 2) {
+        return "parallel <command> <args1> [<args2> ...] - runs command once per argument set on all cores. Arguments within a set are separated by commas.";
+    }
+
+    command_t cmd = findCommand(params[0]);
+
+    std::vector<params_t> argSets;
+    for (uint i = 1; i < params.size(); i++) {
+        params_t args;
+        std::stringstream ss(params[i]);
+        std::string arg;
+        while (std::getline(ss, arg, ',')) {
+            args.push_back(arg);
+        }
+        argSets.push_back(args);
+    }
+
+    std::vector<std::string> results(argSets.size());
+    parallelFor(argSets.size(), [&](size_t i) {
+        try {
+            token.check();
+            results[i] = cmd(isHelpRequest(argSets[i]), argSets[i], token);
+        }
+        catch (const std::exception& e) {
+            results[i] = std::string("Error: ") + e.what();
+        }
+    });
+
+    std::stringstream out;
+    for (uint i = 0; i < results.size(); i++) {
+        if (i > 0) out << std::endl;
+        out << results[i];
+    }
+    token.check();
+    return out.str();
+}
+
+///////////////////////////////////
+//
+// Deadline Functions
+//
+unsigned long parseTimeout(const std::string& text)
+{
+    char* end;
+    unsigned long ms = strtoul(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0') {
+        std::stringstream err;
+        err << "Invalid timeout " << text << ".";
+        throw std::runtime_error(err.str());
+    }
+    return ms;
+}
+
+result_t console_timeout(bool bHelp, const params_t& params, const CancelToken& token)
+{
+    if (bHelp || params.size() < 2) {
+        return "timeout <ms> <command> [<arg1> ...] - runs command, failing if it takes longer than ms milliseconds.";
+    }
+
+    CancelToken child = token.child();
+    child.setTimeout(parseTimeout(params[0]));
+
+    params_t args(params.begin() + 2, params.end());
+    return runCancellable(findCommand(params[1]), isHelpRequest(args), args, child);
+}
+
+result_t console_deadline(bool bHelp, const params_t& params)
+{
+    if (bHelp || params.size() > 1) {
+        return "deadline [<ms>] - shows or sets the timeout for every command. 0 disables it.";
+    }
+
+    unsigned long ms;
+    if (params.size() == 1) {
+        ms = parseTimeout(params[0]);
+        defaultTimeoutMs = ms;
+    }
+    else {
+        ms = defaultTimeoutMs;
+    }
+
+    if (ms == 0) return "No deadline.";
+
+    std::stringstream out;
+    out << "Deadline is " << ms << " ms.";
+    return out.str();
+}
+
+///////////////////////////////////
+//
+// Watch Functions
+//
+result_t console_watch(bool bHelp, const params_t& params)
+{
+    if (bHelp || params.size() == 0 || (params.size() == 1) != (params[0] == "off")) {
+        return "watch <ms> <command> [<arg1> ...] - reruns command every ms milliseconds above the prompt, redrawing only the lines that change. \"watch off\" stops it.";
+    }
+
+    if (params[0] == "off") {
+        if (!watcher.isActive()) return "Not watching.";
+        watcher.stop();
+        return "Stopped watching.";
+    }
+
+    // runs are started and shown by the console while it waits for a key
+    if (!cs.hasIdleHandler()) throw std::runtime_error("watch only works in the interactive console.");
+
+    unsigned long intervalMs = parseTimeout(params[0]);
+    if (intervalMs == 0) {
+        std::stringstream err;
+        err << "Invalid interval " << params[0] << ".";
+        throw std::runtime_error(err.str());
+    }
+
+    command_t cmd = findCommand(params[1]);
+    params_t args(params.begin() + 2, params.end());
+    bool bCmdHelp = isHelpRequest(args);
+
+    std::string description = params[1];
+    for (uint i = 0; i < args.size(); i++) {
+        description += " " + args[i];
+    }
+
+    watcher.start(description, intervalMs, defaultTimeoutMs, [=](const CancelToken& token) {
+        return cmd(bCmdHelp, args, token);
+    });
+
+    std::stringstream out;
+    out << "Watching " << description << " every " << intervalMs << " ms.";
+    return out.str();
+}
+
 ///////////////////////////////////
 //
 // Command Registration Functions
 //
 void addCommand(const std::string& cmdName, fAction cmdFunc)
 {
+    addCommand(cmdName, cmdFunc, 0);
+}
+
+void addCommand(const std::string& cmdName, fCancellableAction cmdFunc)
+{
+    addCommand(cmdName, cmdFunc, 0);
+}
+
+void addCommand(const std::string& cmdName, fAction cmdFunc, int flags)
+{
+    std::lock_guard<std::recursive_mutex> lock(command_mutex);
+    command_map[cmdName] = [cmdFunc](bool bHelp, const params_t& params, const CancelToken&) {
+        return cmdFunc(bHelp, params);
+    };
+    command_flags[cmdName] = flags;
+}
+
+void addCommand(const std::string& cmdName, fCancellableAction cmdFunc, int flags)
+{
+    std::lock_guard<std::recursive_mutex> lock(command_mutex);
     command_map[cmdName] = cmdFunc;
+    command_flags[cmdName] = flags;
+}
+
+void addModuleManifest(const std::string& manifestPath)
+{
+    std::lock_guard<std::recursive_mutex> lock(command_mutex);
+    modules.loadManifest(manifestPath);
 }
 
 void initCommands()
 {
+    std::lock_guard<std::recursive_mutex> lock(command_mutex);
     command_map.clear();
-    command_map["help"] = &console_help;
-    command_map["echo"] = &console_echo;
+    command_flags.clear();
+    modules.clear();
+    addCommand("help", &console_help);
+    addCommand("echo", &console_echo);
+    addCommand("jobs", &console_jobs);
+    addCommand("wait", &console_wait, COMMAND_RAW_PARAMS); // %N is a job id
+    addCommand("kill", &console_kill, COMMAND_RAW_PARAMS);
+    addCommand("parallel", &console_parallel);
+    addCommand("timeout", &console_timeout);
+    addCommand("deadline", &console_deadline);
+    addCommand("watch", &console_watch);
+
+    const char* manifest = getenv("CONSOLESHELL_MODULES");
+    if (manifest && *manifest) {
+        try {
+            modules.loadManifest(manifest);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+    }
 }
 
 //////////////////////////////////
@@ -114,32 +435,28 @@ bool getInput(std::string& input)
     input = cs.getLine();
     if (input != "") {
         input_history.push_back(input);
+        snapshot.appendInputHistory(input);
         return true;
     }
     return false;
 }
 
-void doOutput(const std::string& output)
+// Color escapes are rendered but not kept in the history, so that %N
+// references substitute plain text.
+void doOutput(const std::string& output, const std::string& tag = "")
 {
-    output_history.push_back(output);
+    output_history.push_back(stripEscapes(output));
+    snapshot.appendOutputHistory(output_history.back());
     std::stringstream out;
-    out << "Out: [" << output_history.size() << "] " << output;
-
-    std::string line;
-    while (std::getline(out, line, '\n')) {
-        cs.putLine(line);
-    }
+    out << "Out: [" << output_history.size() << "] " << tag << output;
+    cs.putLine(out.str());
 }
 
-void doError(const std::string& error)
+void doError(const std::string& error, const std::string& tag = "")
 {
     std::stringstream err;
-    err << "Error: " << error;
-
-    std::string line;
-    while (std::getline(err, line, '\n')) {
-        cs.putLine(line);
-    }
+    err << colorSpan("Error: ", COLOR_RED) << tag << error;
+    cs.putLine(err.str());
 }
 
 void showCommand(const std::string command, params_t& params)
@@ -150,16 +467,69 @@ void showCommand(const std::string command, params_t& params)
         cmd << " " << params[i];
     }
 
-    std::string line;
-    while (std::getline(cmd, line, '\n')) {
-        cs.putLine(cmd.str());
-    }
+    cs.putLine(cmd.str());
 }
 
 void newline()
 {
     cs.putLine("\n");
 }
+
+// Starts the watched command when it is due and shows its latest output.
+// Called by the console while it waits for a key.
+static int pollWatch()
+{
+    if (!watcher.isActive()) {
+        cs.clearWatch();
+        return -1;
+    }
+
+    std::string output;
+    bool bError;
+    if (watcher.poll(output, bError)) {
+        std::stringstream header;
+        header << "Every " << watcher.interval() << " ms: " << watcher.description();
+
+        std::vector<AttrLine> region(1, AttrLine(header.str(), COLOR_PAIR(PAIR_CYAN)));
+        if (bError) {
+            region.push_back(AttrLine("Error: ", COLOR_PAIR(PAIR_RED)).append(output, COLOR_PAIR(PAIR_WHITE)));
+        }
+        else {
+            std::vector<AttrLine> parsed = AttrLine::parse(output, COLOR_PAIR(PAIR_WHITE));
+            region.insert(region.end(), parsed.begin(), parsed.end());
+        }
+        cs.setWatch(region);
+    }
+    return watcher.nextPollMs();
+}
+
+// Attaches the results of finished background jobs to the output history.
+void reapJobs()
+{
+    std::vector<Job> finished = jobs.reap();
+    for (uint i = 0; i < finished.size(); i++) {
+        std::stringstream tag;
+        tag << "(job " << finished[i].id << ") ";
+        if (finished[i].state == JOB_DONE) {
+            doOutput(finished[i].result, tag.str());
+        }
+        else {
+            doError(finished[i].result, tag.str());
+        }
+        newline();
+    }
+}
+
+// Strips a trailing & from the input. Returns true if there was one.
+bool parseBackground(std::string& input)
+{
+    size_t end = input.find_last_not_of(" \t");
+    if (end == std::string::npos || input[end] != '&') return false;
+    if (input.find_first_not_of(" \t&") == std::string::npos) return false;
+
+    input.erase(end);
+    return true;
+}
  
 // precondition:    input is not empty
 // postcondition:   command contains the first token, params contains the rest
@@ -213,8 +583,10 @@ int repeatCount(const std::string& str, char c)
     return str.size(); 
 }
 
-void substituteTokens(params_t& params)
+void substituteTokens(const std::string& command, params_t& params)
 {
+    if (commandFlags(command) & COMMAND_RAW_PARAMS) return;
+
     int last_output = output_history.size() - 1;
 
     for (uint i = 0; i < params.size(); i++) {
@@ -256,17 +628,90 @@ void substituteTokens(params_t& params)
 //
 // Command interpreter
 //
-std::string execCommand(const std::string& command, params_t& params)
+// Loads the command's module if it has not been loaded yet.
+command_t findCommand(const std::string& command)
 {
+    std::lock_guard<std::recursive_mutex> lock(command_mutex);
     command_map_t::iterator it = command_map.find(command);
+    if (it == command_map.end() && modules.load(command)) {
+        it = command_map.find(command);
+    }
     if (it == command_map.end()) {
         std::stringstream ss;
         ss << "Invalid command " << command << ".";
         throw std::runtime_error(ss.str());
     }
+    return it->second;
+}
+
+// Also loads the command's module, so that its flags are known.
+int commandFlags(const std::string& command)
+{
+    std::lock_guard<std::recursive_mutex> lock(command_mutex);
+    findCommand(command);
+    return command_flags[command];
+}
+
+bool isHelpRequest(const params_t& params)
+{
+    return (params.size() == 1 && (params[0] == "-h" || params[0] == "--help"));
+}
+
+std::string execCommand(const std::string& command, params_t& params)
+{
+    return findCommand(command)(isHelpRequest(params), params, CancelToken());
+}
+
+// Runs the command on a worker thread and returns as soon as it finishes or
+// the token is cancelled. A command that ignores its token is abandoned and
+// its result discarded.
+result_t runCancellable(const command_t& cmd, bool bHelp, const params_t& params, const CancelToken& token)
+{
+    std::shared_ptr<std::packaged_task<result_t()> > task(
+        new std::packaged_task<result_t()>([=]() { return cmd(bHelp, params, token); }));
+    std::future<result_t> result = task->get_future();
+    std::thread([task]() { (*task)(); }).detach();
+
+    while (result.wait_for(std::chrono::milliseconds(COMMAND_POLL_MS)) != std::future_status::ready) {
+        token.check();
+    }
+    token.check();
+    return result.get();
+}
+
+// Commands entered at the prompt can be interrupted with Ctrl-C.
+std::string execForeground(const std::string& command, params_t& params)
+{
+    command_t cmd = findCommand(command);
+
+    CancelToken token;
+    token.setTimeout(defaultTimeoutMs);
+    token.setInterruptFlag(&bInterrupted);
+    bInterrupted = 0;
+    return runCancellable(cmd, isHelpRequest(params), params, token);
+}
+
+// The command is looked up on the calling thread so that only the command
+// itself runs on the worker.
+unsigned int execBackground(const std::string& command, params_t& params)
+{
+    command_t cmd = findCommand(command);
+    bool bHelp = isHelpRequest(params);
+
+    std::string description = command;
+    for (uint i = 0; i < params.size(); i++) {
+        description += " " + params[i];
+    }
+
+    CancelToken token;
+    token.setTimeout(defaultTimeoutMs);
 
-    bool bHelp = (params.size() == 1 && (params[0] == "-h" || params[0] == "--help"));
-    return it->second(bHelp, params);
+    params_t args(params);
+    return jobs.start(description, [=]() {
+        result_t result = cmd(bHelp, args, token);
+        token.check();
+        return result;
+    }, token);
 }
 
 //////////////////////////////////
@@ -284,34 +729,314 @@ static void loop()
         while (!getInput(input));
         if (input == "exit") break;
 
+        reapJobs();
+
+        bool bBackground = parseBackground(input);
         parseInput(input, command, params);
         try {
-            substituteTokens(params);
+            substituteTokens(command, params);
             newline();
             showCommand(command, params);
-            output = execCommand(command, params);
-            doOutput(output);
+            if (bBackground) {
+                std::stringstream ss;
+                ss << "Job [" << execBackground(command, params) << "] started.";
+                cs.putLine(ss.str());
+            }
+            else {
+                output = execForeground(command, params);
+                doOutput(output);
+            }
             newline();
         }
         catch (const std::exception& e) {
             doError(e.what());
             newline();
         }
+
+        reapJobs();
+    }
+}
+
+//////////////////////////////////
+//
+// Machine Protocol
+//
+static void machineLoop(MachineSession& ms)
+{
+    std::string request;
+    std::string command;
+    params_t params;
+
+    while (true) {
+        try {
+            if (!ms.getRequest(request)) break;
+        }
+        catch (const std::exception& e) {
+            ms.putResponse(MACHINE_BAD_FRAME, 0, 0, e.what());
+            break;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int status = MACHINE_OK;
+        unsigned int index = 0;
+        std::string payload;
+
+        // Commands run on this thread - a thread per request would cost
+        // more than most commands do.
+        try {
+            if (request.find_first_not_of(" \t\n") == std::string::npos) {
+                throw std::runtime_error("Empty request.");
+            }
+            input_history.push_back(request);
+            parseInput(request, command, params);
+            substituteTokens(command, params);
+            payload = stripEscapes(execCommand(command, params));
+            output_history.push_back(payload);
+            index = output_history.size();
+        }
+        catch (const std::exception& e) {
+            status = MACHINE_ERROR;
+            payload = e.what();
+        }
+
+        unsigned long micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        ms.putResponse(status, index, micros, payload);
     }
+    ms.flush();
 }
 
-static void initCurses();
-static void stopCurses();
+// Serves one connection at a time. The history is shared between them.
+static int machineListen(const std::string& path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Error: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: Socket path too long." << std::endl;
+        close(fd);
+        return -1;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    // replace a socket left by an earlier run, but nothing else
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            std::cerr << "Error: " << path << " exists and is not a socket." << std::endl;
+            close(fd);
+            return -1;
+        }
+        unlink(path.c_str());
+    }
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        std::cerr << "Error: " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+
+    // a client hanging up must not kill the shell
+    signal(SIGPIPE, SIG_IGN);
+
+    while (true) {
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        MachineSession ms(conn, conn);
+        machineLoop(ms);
+        close(conn);
+    }
+
+    close(fd);
+    unlink(path.c_str());
+    return -1;
+}
+
+static std::unique_ptr<TerminalBackend> term;
+
+static TerminalBackend* createBackend(const std::string& name, FILE* out = NULL, FILE* in = NULL);
+static bool initTerminal(TerminalBackend* backend);
+static void stopTerminal();
+
+// Restores the session saved at path and keeps saving to it.
+static void restoreSession(const std::string& path)
+{
+    SessionState state;
+    try {
+        snapshot.open(path, state);
+    }
+    catch (const std::exception& e) {
+        doError(e.what());
+        newline();
+        return;
+    }
+
+    input_history = state.inputHistory;
+    output_history = state.outputHistory;
+    cs.restore(state);
+    cs.setSnapshot(&snapshot);
+    cs.update();
+}
+
+// Replaces the session journal with a compact copy of the session, so that
+// it does not grow from one run to the next.
+static void saveSession()
+{
+    if (!snapshot.isOpen()) return;
+
+    SessionState state;
+    cs.save(state);
+    state.inputHistory = input_history;
+    state.outputHistory = output_history;
+    try {
+        snapshot.close(state);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+}
+
+static int usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " [--term curses|ansi] [--session <path>] [--record <path>]" << std::endl
+              << "       " << name << " [--term curses|ansi] --replay <path> [--realtime]" << std::endl
+              << "       " << name << " --machine" << std::endl
+              << "       " << name << " --machine-socket <path>" << std::endl
+              << "       " << name << " <command> [<arg1> ...]" << std::endl;
+    return -1;
+}
+
+static int interactive(const std::string& termName, const std::string& sessionPath, const std::string& recordPath)
+{
+    KeyRecorder recorder;
+
+    if (!initTerminal(createBackend(termName))) {
+        std::cerr << "Error: Cannot initialize terminal." << std::endl;
+        return -1;
+    }
+    if (!sessionPath.empty()) restoreSession(sessionPath);
+    if (!recordPath.empty()) {
+        try {
+            recorder.open(recordPath, term->rows(), term->cols());
+            cs.setRecorder(&recorder);
+        }
+        catch (const std::exception& e) {
+            doError(e.what());
+            newline();
+        }
+    }
+
+    loop();
+    stopTerminal();
+    saveSession();
+    return 0;
+}
+
+// Feeds a key log through the console with no terminal attached and
+// reports how long each key took to handle and how much was drawn.
+static int replay(const std::string& termName, const std::string& replayPath, bool bRealtime)
+{
+    KeyReplayer replayer;
+    try {
+        replayer.load(replayPath);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+    replayer.setRealtime(bRealtime);
+
+    // terminal output is collected here only to be measured
+    FILE* termOut = tmpfile();
+    FILE* termIn = fopen("/dev/null", "r");
+    if (!termOut || !termIn) {
+        std::cerr << "Error: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    if (!initTerminal(createBackend(termName, termOut, termIn))) {
+        std::cerr << "Error: Cannot initialize terminal." << std::endl;
+        return -1;
+    }
+    cs.setReplayer(&replayer);
+    loop();
+    stopTerminal();
+    fflush(termOut);
+
+    // the ANSI backend writes to the descriptor directly
+    struct stat st;
+    fstat(fileno(termOut), &st);
+
+    std::cout << replayer.report() << std::endl
+              << "Full repaints: " << cs.getRepaints() << std::endl
+              << "Terminal output (bytes): " << st.st_size << std::endl;
+
+    fclose(termIn);
+    fclose(termOut);
+    return 0;
+}
 
 int startInterpreter(int argc, char** argv)
 {
-    if (argc == 1) {
-        initCurses();
-        loop();
-        stopCurses();
-        return 0;
+    std::string termName("curses");
+    std::string sessionPath;
+    std::string recordPath;
+    std::string replayPath;
+    bool bRealtime = false;
+
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        std::string option(argv[i]);
+        bool bHasArg = (i + 1 < argc);
+
+        if (option == "--machine" && argc == 2) {
+            MachineSession ms(STDIN_FILENO, STDOUT_FILENO);
+            machineLoop(ms);
+            return 0;
+        }
+        else if (option == "--machine-socket" && bHasArg && argc == 3) {
+            return machineListen(argv[2]);
+        }
+        else if (option == "--term" && bHasArg) {
+            termName = argv[++i];
+            if (termName != "curses" && termName != "ansi") return usage(argv[0]);
+        }
+        else if (option == "--session" && bHasArg) {
+            sessionPath = argv[++i];
+        }
+        else if (option == "--record" && bHasArg) {
+            recordPath = argv[++i];
+        }
+        else if (option == "--replay" && bHasArg) {
+            replayPath = argv[++i];
+        }
+        else if (option == "--realtime") {
+            bRealtime = true;
+        }
+        else {
+            return usage(argv[0]);
+        }
     }
 
+    if (!replayPath.empty()) {
+        if (i < argc || !sessionPath.empty() || !recordPath.empty()) return usage(argv[0]);
+        return replay(termName, replayPath, bRealtime);
+    }
+
+    if (i == argc) return interactive(termName, sessionPath, recordPath);
+    if (i > 1) return usage(argv[0]);
+
     params_t params;
     for (int i = 2; i < argc; i++) {
         params.push_back(argv[i]);
@@ -328,73 +1053,58 @@ int startInterpreter(int argc, char** argv)
     return 0;
 }
 
-static void finish(int sig)
+// Ctrl-C cancels the running command rather than ending the session.
+static void handle_interrupt(int sig)
 {
-    stopCurses();
+    bInterrupted = 1;
+}
 
-    /* do your non-curses wrapup here */
+// The session ends at the prompt, where it is saved as on exit. A command
+// still running is cancelled first.
+static void handle_terminate(int sig)
+{
+    bTerminated = 1;
+    bInterrupted = 1;
+}
 
-    exit(0);
+// With no streams given, the backend runs on the controlling terminal. The
+// ANSI backend takes no input when given streams.
+static TerminalBackend* createBackend(const std::string& name, FILE* out, FILE* in)
+{
+    if (name == "ansi") {
+        if (out) return new AnsiBackend(fileno(out), -1);
+        return new AnsiBackend();
+    }
+    return new CursesBackend(out, in);
 }
 
-// SIGWINCH is called when the window is resized.
-static void handle_winch(int sig)
+// Window resizes are left to the backend, which reports them to getLine() as
+// KEY_RESIZE so that they can be recorded with the other keys.
+static bool initTerminal(TerminalBackend* backend)
 {
-    signal(SIGWINCH, SIG_IGN);
+    signal(SIGINT, handle_interrupt);
+    // without SA_RESTART, so that a blocked key read returns
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_terminate;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    cs.setExitFlag(&bTerminated);
 
-    // Reinitialize the window to update data structures.
-    endwin();
-    initscr();
-    refresh();
-    cs.update();
-    //clear();
-/*
-    stringstream ss;
-    ss << COLS << " x " << LINES;
-    const string& dims = ss.str();
-
-    // Approximate the center
-    int x = COLS / 2 - dims.size() / 2;
-    int y = LINES / 2 - 1;
-
-    mvaddstr(y, x, dims.c_str());
-    refresh();
-*/
-    signal(SIGWINCH, handle_winch);
-}
-
-static void initCurses()
-{
-    signal(SIGINT, finish);
-    signal(SIGWINCH, handle_winch);
-
-    initscr();      /* initialize the curses library */
-    keypad(stdscr, TRUE);  /* enable keyboard mapping */
-    nonl();         /* tell curses not to do NL->CR/NL on output */
-    cbreak();       /* take input chars one at a time, no wait for \n */
-    noecho();
-
-    if (has_colors())
-    {
-        start_color();
-    
-        /*
-         * Simple color assignment, often all we need.  Color pair 0 cannot
-     * be redefined.  This example uses the same value for the color
-     * pair as for the foreground color, though of course that is not
-     * necessary:
-         */
-        init_pair(1, COLOR_RED,     COLOR_BLACK);
-        init_pair(2, COLOR_GREEN,   COLOR_BLACK);
-        init_pair(3, COLOR_YELLOW,  COLOR_BLACK);
-        init_pair(4, COLOR_BLUE,    COLOR_BLACK);
-        init_pair(5, COLOR_CYAN,    COLOR_BLACK);
-        init_pair(6, COLOR_MAGENTA, COLOR_BLACK);
-        init_pair(7, COLOR_WHITE,   COLOR_BLACK);
-    }
-}
-
-static void stopCurses()
-{
-    endwin();
+    // so that curses passes UTF-8 through
+    setlocale(LC_ALL, "");
+
+    term.reset(backend);
+    if (!term->init()) {
+        term.reset();
+        return false;
+    }
+    cs.setBackend(term.get());
+    cs.setIdleHandler(&pollWatch);
+    return true;
+}
+
+static void stopTerminal()
+{
+    if (term) term->shutdown();
 }
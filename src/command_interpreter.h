@@ -28,13 +28,37 @@
 #include <string>
 #include <vector>
 
+#include "cancel_token.h"
+
 typedef std::vector<std::string>    params_t;
 typedef std::string                 result_t;
 typedef result_t                    (*fAction)(bool, const params_t&);
 
+// Long-running commands should poll the token and return or throw once it
+// is cancelled, either by Ctrl-C or because its deadline has passed.
+typedef result_t                    (*fCancellableAction)(bool, const params_t&, const CancelToken&);
+
+// Flags for addCommand().
+enum {
+    COMMAND_RAW_PARAMS = 1      // parameters are passed as typed, without %N or null substitution
+};
+
 void addCommand(const std::string& cmdName, fAction cmdFunc);
+void addCommand(const std::string& cmdName, fCancellableAction cmdFunc);
+void addCommand(const std::string& cmdName, fAction cmdFunc, int flags);
+void addCommand(const std::string& cmdName, fCancellableAction cmdFunc, int flags);
+
+// Declares commands provided by shared object modules. See module_loader.h
+// for the manifest format. initCommands() forgets earlier manifests, then
+// reads the one named by the CONSOLESHELL_MODULES environment variable.
+void addModuleManifest(const std::string& manifestPath);
+
 void initCommands();
 
 int startInterpreter(int argc, char** argv);
 
+// Wraps text in ANSI color escapes so that commands can return colored
+// output. color is one of the curses COLOR_* constants.
+std::string colorSpan(const std::string& text, int color, bool bBold = false);
+
 #endif // COMMAND_INTERPRETER__H_
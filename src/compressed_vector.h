@@ -0,0 +1,228 @@
+#ifndef _COMPRESSED_VECTOR_H__
+#define _COMPRESSED_VECTOR_H__
+
+#include "lz_codec.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <list>
+#include <deque>
+#include <string>
+#include <stdexcept>
+
+// Serializes elements into a block. Specialize it for each element type with
+// encode(), which appends an element to a buffer, and decode(), which reads
+// one back and advances pos, throwing if it would read past end.
+template <typename T>
+struct block_codec;
+
+template <>
+struct block_codec<std::string>
+{
+    static void putUint32(std::string& out, uint32_t n)
+    {
+        out.append((const char*)&n, sizeof(n));
+    }
+
+    static uint32_t getUint32(const char*& pos, const char* end)
+    {
+        uint32_t n;
+        if ((size_t)(end - pos) < sizeof(n)) throw std::runtime_error("Corrupt compressed block.");
+        memcpy(&n, pos, sizeof(n));
+        pos += sizeof(n);
+        return n;
+    }
+
+    static void encode(const std::string& str, std::string& out)
+    {
+        putUint32(out, str.size());
+        out += str;
+    }
+
+    static std::string decode(const char*& pos, const char* end)
+    {
+        uint32_t n = getUint32(pos, end);
+        if ((size_t)(end - pos) < n) throw std::runtime_error("Corrupt compressed block.");
+        std::string str(pos, n);
+        pos += n;
+        return str;
+    }
+};
+
+// An append-only sequence that keeps all but its newest elements compressed.
+// Elements are gathered into an open block of blockSize. Once full, the block
+// is sealed: encoded with block_codec<T> and compressed with lzCompress. A
+// sealed block is decompressed again when one of its elements is read, and
+// kept in a cache of the hotBlocks most recently read blocks.
+//
+// A reference from operator[] stays valid until a read of another sealed
+// block evicts the one it points into, so hold on to copies instead.
+template <typename T>
+class compressed_vector
+{
+private:
+    typedef std::pair<size_t, std::vector<T> > hot_block;
+
+    struct sealed_block
+    {
+        const char* data;   // adopted blocks only
+        size_t size;
+        long owned;         // index into owned, or -1 if adopted
+    };
+
+    size_t blockSize;
+    size_t hotBlocks;
+
+    std::vector<sealed_block> sealed;
+    std::deque<std::string> owned;
+    std::vector<T> tail;
+    mutable std::list<hot_block> hot; // most recently read first
+
+    void seal();
+    void decode(const char* compressed, size_t size, std::vector<T>& values) const;
+    const std::vector<T>& block(size_t n) const;
+
+public:
+    compressed_vector(size_t _blockSize = 256, size_t _hotBlocks = 4)
+        : blockSize(_blockSize), hotBlocks(_hotBlocks) { }
+
+    size_t size() const { return sealed.size() * blockSize + tail.size(); }
+    bool empty() const { return sealed.empty() && tail.empty(); }
+
+    void push_back(const T& value);
+    const T& operator[](size_t i) const;
+    const T& back() const { return tail.empty() ? (*this)[size() - 1] : tail.back(); }
+
+    void clear();
+
+    template <typename InputIterator>
+    void assign(InputIterator first, InputIterator last)
+    {
+        clear();
+        for (; first != last; ++first) push_back(*first);
+    }
+
+    // Sealed blocks in order, as lzCompress output. A block sealed by one
+    // vector can be adopted by another with the same block size. Adopted
+    // bytes are not copied, so they must outlive the vector and its copies.
+    // Blocks can only be adopted while the open block is empty; otherwise
+    // adoptSealed() returns false. A block that does not decode to a full
+    // block is refused with std::runtime_error.
+    size_t blockLength() const { return blockSize; }
+    size_t sealedBlocks() const { return sealed.size(); }
+    const char* sealedBlock(size_t n, size_t& size) const;
+    bool adoptSealed(const char* data, size_t size);
+
+    size_t compressedBytes() const; // sealed blocks only
+};
+
+template <typename T>
+void compressed_vector<T>::seal()
+{
+    std::string data;
+    for (size_t i = 0; i < tail.size(); i++) {
+        block_codec<T>::encode(tail[i], data);
+    }
+    owned.push_back(lzCompress(data));
+    sealed_block block = { NULL, owned.back().size(), (long)owned.size() - 1 };
+    sealed.push_back(block);
+
+    // the block just written is the likeliest to be read next
+    hot.push_front(hot_block(sealed.size() - 1, std::vector<T>()));
+    hot.front().second.swap(tail);
+    if (hot.size() > hotBlocks) hot.pop_back();
+}
+
+template <typename T>
+void compressed_vector<T>::decode(const char* compressed, size_t size, std::vector<T>& values) const
+{
+    std::string data = lzDecompress(compressed, size);
+    values.reserve(blockSize);
+    const char* pos = data.data();
+    const char* end = pos + data.size();
+    while (pos < end) {
+        values.push_back(block_codec<T>::decode(pos, end));
+    }
+    if (values.size() != blockSize) throw std::runtime_error("Corrupt compressed block.");
+}
+
+template <typename T>
+const std::vector<T>& compressed_vector<T>::block(size_t n) const
+{
+    for (typename std::list<hot_block>::iterator it = hot.begin(); it != hot.end(); ++it) {
+        if (it->first != n) continue;
+        if (it != hot.begin()) hot.splice(hot.begin(), hot, it);
+        return it->second;
+    }
+
+    size_t size;
+    const char* compressed = sealedBlock(n, size);
+    std::vector<T> values;
+    decode(compressed, size, values);
+
+    if (hot.size() >= hotBlocks && !hot.empty()) hot.pop_back();
+    hot.push_front(hot_block(n, std::vector<T>()));
+    hot.front().second.swap(values);
+    return hot.front().second;
+}
+
+template <typename T>
+void compressed_vector<T>::push_back(const T& value)
+{
+    tail.push_back(value);
+    if (tail.size() >= blockSize) seal();
+}
+
+template <typename T>
+const T& compressed_vector<T>::operator[](size_t i) const
+{
+    size_t n = i / blockSize;
+    if (n == sealed.size()) return tail[i % blockSize];
+    return block(n)[i % blockSize];
+}
+
+template <typename T>
+void compressed_vector<T>::clear()
+{
+    sealed.clear();
+    owned.clear();
+    tail.clear();
+    hot.clear();
+}
+
+template <typename T>
+const char* compressed_vector<T>::sealedBlock(size_t n, size_t& size) const
+{
+    size = sealed[n].size;
+    return sealed[n].owned < 0 ? sealed[n].data : owned[sealed[n].owned].data();
+}
+
+template <typename T>
+bool compressed_vector<T>::adoptSealed(const char* data, size_t size)
+{
+    if (!tail.empty()) return false;
+
+    // decoded now so that a bad block fails here rather than when it is read
+    std::vector<T> values;
+    decode(data, size, values);
+
+    sealed_block block = { data, size, -1 };
+    sealed.push_back(block);
+    if (hot.size() >= hotBlocks && !hot.empty()) hot.pop_back();
+    hot.push_front(hot_block(sealed.size() - 1, std::vector<T>()));
+    hot.front().second.swap(values);
+    return true;
+}
+
+template <typename T>
+size_t compressed_vector<T>::compressedBytes() const
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < sealed.size(); i++) {
+        bytes += sealed[i].size;
+    }
+    return bytes;
+}
+
+#endif // _COMPRESSED_VECTOR_H__
@@ -12,6 +12,5 @@
 int main(int argc, char *argv[])
 {
     initCommands();
-    startInterpreter(argc, argv);
-    return 0;
+    return startInterpreter(argc, argv);
 }
@@ -23,9 +23,11 @@
 // THE SOFTWARE.
 
 #include "console_session.h"
+#include "utf8.h"
 
 #include <stdlib.h>
 #include <sstream>
+#include <algorithm>
 
 // KEY_ENTER = 232 rather than 13
 #define _KEY_ENTER      13
@@ -33,23 +35,11 @@
 #define CTRL_F          6
 #define CTRL_B          2
 
-inline static int mapRow(int row, int col, int mode = MAP_WRAP_AROUND)
-{
-    if (mode == MAP_WRAP_AROUND) return row + col/COLS;
-    else return row;
-}
-
-inline static int mapCol(int row, int col, int mode = MAP_WRAP_AROUND)
-{
-    if (mode == MAP_WRAP_AROUND) return col % COLS;
-    else return col;
-}
-
 //
 // Public Methods
 //
 ConsoleSession::ConsoleSession(const std::string& _prompt, int _mode) :
-    cursorRow(0), cursorCol(0), scrollRows(0), prompt(_prompt), mode(_mode), bReplace(false), currentInput(0)
+    cursorPos(0), scrollRows(0), inputOffset(0), prompt(_prompt), pEdit(&newLine), mode(_mode), bReplace(false), currentInput(0), snapshot(NULL), recorder(NULL), replayer(NULL), repaints(0), term(NULL), pExit(NULL)
 {
 }
 
@@ -59,175 +49,420 @@ ConsoleSession::~ConsoleSession()
 
 std::string ConsoleSession::getLine()
 {
-    logical_move(cursorRow, cursorCol);
-    attrset(COLOR_PAIR(4));
-    logical_mvaddstr(cursorRow, 0, prompt.c_str());
-    attrset(COLOR_PAIR(7));
-
-    // clear rest of line if necessary
-    std::string blank(LINES - prompt.size(), ' ');
-    addstr(blank.c_str());
-
     newLine = "";
     pEdit = &newLine;
     currentInput = input.size();
-    cursorCol = prompt.size();
-
-    logical_move(cursorRow, cursorCol);
+    cursorPos = 0;
+    inputOffset = 0;
+    partialChar = "";
 
     while (true)
     {
-        if (isCursorInScreen()) {
-            // only highlight cursor if it's on the screen.
-            chgat(1, A_STANDOUT, 0, NULL);
-        }
-        int c = getch();
-        chgat(1, A_NORMAL, 0, NULL);
+        if (idleHandler) term->setKeyTimeout(idleHandler());
+        drawInput();
+        int c = exitRequested() ? KEY_EOF : readKey();
+        if (c == ERR && exitRequested()) c = KEY_EOF;
         if (c == _KEY_ENTER) break;
+        if (c == ERR) continue; // interrupted by a signal, or idle
+
+        if (c == KEY_EOF) {
+            newLine = "exit";
+            pEdit = &newLine;
+            break;
+        }
+
+        if (c == KEY_RESIZE) {
+            update();
+            continue;
+        }
 
         if (!handleMotion(c) &&
-            !handleEdit(c) &&
-            !handleVisible(c))
+            !handleEdit(c))
         {
-            std::stringstream ss;
-            ss << c;
-            logical_mvaddstr(1, 0, ss.str().c_str());
-            addstr("     ");
+            handleVisible(c);
         }
     }
-    cursorRow++;
-    cursorCol = 0;
 
     std::string newInput(*pEdit);
+    newLine = "";
+    pEdit = &newLine; // the history entry it may point to is about to be cleaned
+    cursorPos = 0;
+    inputOffset = 0;
+
     input.clean();
     input.push_back(newInput);
-    lines.push_back(prompt + newInput);
-    prompts.push_back(prompt);
+
+    // entering a command brings the newest output back into view
+    if (scrollRows > 0) scrollTo(0);
+    appendOutput(AttrLine(prompt, COLOR_PAIR(PAIR_BLUE)).append(newInput, COLOR_PAIR(PAIR_WHITE)));
+    drawInput();
+
+    if (snapshot) {
+        snapshot->appendInput(newInput);
+        snapshot->appendLine(lines.back());
+        snapshot->setCursor(lines.size(), cursorPos, scrollRows);
+    }
     return newInput;
 }
 
 void ConsoleSession::putLine(const std::string& line)
 {
-    attrset(COLOR_PAIR(7));
-    logical_mvaddstr(cursorRow, 0, line.c_str());
-    cursorRow++;
-    cursorCol = 0;
-
-    lines.push_back(line);
-    prompts.push_back("");
+    std::vector<AttrLine> parsed = AttrLine::parse(line, COLOR_PAIR(PAIR_WHITE));
+    for (unsigned int i = 0; i < parsed.size(); i++) {
+        putLine(parsed[i]);
+    }
 }
 
-bool ConsoleSession::isCursorInScreen() const
+void ConsoleSession::putLine(const AttrLine& line)
 {
-    return ((int)(cursorRow - scrollRows) < LINES);
+    appendOutput(line);
+
+    if (snapshot) {
+        snapshot->appendLine(line);
+        snapshot->setCursor(lines.size(), cursorPos, scrollRows);
+    }
 }
 
 void ConsoleSession::update()
 {
-    refresh();
-    clear();
-
-    unsigned int i = 0;
-    unsigned int j = 0;
-    for (; i < lines.size(); i++) {
-        if (i >= scrollRows + LINES) return;
-
-        if (prompts[i] != "") {
-            attrset(COLOR_PAIR(4));
-            logical_mvaddstr(i, 0, prompts[i].c_str(), false);
-            attrset(COLOR_PAIR(7));
-            logical_mvaddstr(i, prompts[i].size(), input[j++].c_str(), false);
-        }
-        else {
-            logical_mvaddstr(i, 0, lines[i].c_str(), false);
-        }
+    repaints++;
+    term->clear();
+
+    if (scrollRows >= lines.size()) scrollRows = lines.empty() ? 0 : lines.size() - 1;
+    drawOutput(0, outputRows() - 1);
+    for (int i = 0; i < watchRows(); i++) {
+        drawWatch(i);
     }
+    drawInput();
+}
 
-    attrset(COLOR_PAIR(4));
-    logical_mvaddstr(i, 0, prompt.c_str(), false);
-    attrset(COLOR_PAIR(7));
-    logical_mvaddstr(i, prompt.size(), pEdit->c_str(), false);
-    //chgat(1, A_STANDOUT, 0, NULL);
+void ConsoleSession::scrollTo(unsigned int rows)
+{
+    if (rows >= lines.size()) rows = lines.empty() ? 0 : lines.size() - 1;
+    scrollRows = rows;
+    if (snapshot) snapshot->setCursor(lines.size(), cursorPos, scrollRows);
+    drawOutput(0, outputRows() - 1);
 }
 
-void ConsoleSession::autoScroll(unsigned int row)
+void ConsoleSession::setWatch(const std::vector<AttrLine>& region)
 {
-    if (row < scrollRows) {
-        scrollTo(row);
+    int oldRows = outputRows();
+    int oldWatchRows = watchRows();
+    std::vector<AttrLine> old;
+    old.swap(watchLines);
+    watchLines = region;
+
+    if (outputRows() != oldRows) {
+        resizeOutput(oldRows);
+        for (int i = 0; i < watchRows(); i++) {
+            drawWatch(i);
+        }
+        return;
     }
-    else if (row >= scrollRows + LINES) {
-        scrollTo(row - LINES + 1);
+
+    for (int i = 0; i < watchRows(); i++) {
+        if (i >= oldWatchRows || watchLines[i] != old[i]) drawWatch(i);
     }
 }
 
+void ConsoleSession::clearWatch()
+{
+    if (watchLines.empty()) return;
+
+    int oldRows = outputRows();
+    watchLines.clear();
+    resizeOutput(oldRows);
+}
+
+// Replaces the session contents. The snapshot, if any, is not written to.
+// Sealed scrollback blocks are shared with state rather than decoded.
+void ConsoleSession::restore(const SessionState& state)
+{
+    lines = state.lines;
+    input.clean();
+    input.assign(state.input.begin(), state.input.end());
+
+    cursorPos = 0;
+    inputOffset = 0;
+    scrollRows = std::min<unsigned int>(state.scrollRows, lines.empty() ? 0 : lines.size() - 1);
+}
+
+void ConsoleSession::save(SessionState& state) const
+{
+    state.lines = lines;
+    state.input.assign(input.begin(), input.end());
+}
+
 //
 // Protected Methods
 //
-int ConsoleSession::logical_move(int row, int col, bool bAutoScroll)
+int ConsoleSession::outputRows() const
 {
-    int newRow = mapRow(row, col, mode);
-    if (bAutoScroll) autoScroll(newRow);
-    return move(newRow - scrollRows, mapCol(row, col, mode));
+    int rows = term->rows() - 1 - watchRows();
+    return rows > 0 ? rows : 0;
 }
 
-int ConsoleSession::logical_mvchgat(int row, int col, int n, attr_t attr, short color, const void* opts, bool bAutoScroll)
+int ConsoleSession::watchRows() const
 {
-    int newRow = mapRow(row, col, mode);
-    if (bAutoScroll) autoScroll(newRow);
-    return mvchgat(newRow - scrollRows, mapCol(row, col, mode), n, attr, color, opts);
+    return std::min<int>(watchLines.size(), std::max(term->rows() - 1, 0) / 2);
 }
 
-int ConsoleSession::logical_mvaddch(int row, int col, const chtype c, bool bAutoScroll)
+// Screen rows taken by a line in the output pane. A wide character that
+// does not fit at the end of a row moves to the next one.
+int ConsoleSession::lineHeight(const AttrLine& line) const
 {
-    int newRow = mapRow(row, col, mode);
-    if (bAutoScroll) autoScroll(newRow);
-    return mvaddch(newRow - scrollRows, mapCol(row, col, mode), c);
+    size_t cols = term->cols();
+    if (mode != MAP_WRAP_AROUND || line.width() <= cols) return 1;
+    if (line.isAscii()) return (line.width() + cols - 1) / cols;
+
+    const std::string& text = line.text();
+    int rows = 1;
+    size_t col = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        int width;
+        pos = nextCluster(text.c_str(), text.size(), pos, width);
+        if (col + width > cols) {
+            rows++;
+            col = 0;
+        }
+        col += width;
+    }
+    return rows;
 }
 
-int ConsoleSession::logical_mvaddstr(int row, int col, const char* str, bool bAutoScroll)
+// Draws a line whose first row is the pane row top, which may be above the
+// pane. ASCII lines are cut into rows by length; others are laid out a
+// character at a time.
+void ConsoleSession::drawLine(const AttrLine& line, int top, int first, int last)
 {
-    int newRow = mapRow(row, col, mode);
-    if (bAutoScroll) autoScroll(newRow);
-    return mvaddstr(newRow - scrollRows, mapCol(row, col, mode), str);
+    int cols = term->cols();
+    const std::string& text = line.text();
+    const std::vector<attr_span>& spans = line.spans();
+
+    if (line.isAscii()) {
+        for (unsigned int i = 0; i < spans.size(); i++) {
+            size_t pos = spans[i].start;
+            size_t end = pos + spans[i].length;
+            while (pos < end) {
+                int row = top;
+                int col = pos;
+                size_t chunk = end - pos;
+                if (mode == MAP_WRAP_AROUND) {
+                    row += pos / cols;
+                    col = pos % cols;
+                    chunk = std::min<size_t>(chunk, cols - col);
+                }
+                if (row > last) return;
+                if (row >= first) term->putText(row, col, text.c_str() + pos, chunk, spans[i].attr);
+                pos += chunk;
+            }
+        }
+        return;
+    }
+
+    int row = top;
+    int col = 0;
+    for (unsigned int i = 0; i < spans.size(); i++) {
+        size_t pos = spans[i].start;
+        size_t end = pos + spans[i].length;
+        while (pos < end) {
+            int width;
+            size_t next = nextCluster(text.c_str(), end, pos, width);
+            if (mode == MAP_WRAP_AROUND && col + width > cols) {
+                row++;
+                col = 0;
+            }
+            if (row > last) return;
+            if (row >= first) term->putText(row, col, text.c_str() + pos, next - pos, spans[i].attr);
+            col += width;
+            pos = next;
+        }
+    }
+}
+
+// Lines are laid out upwards from the bottom of the pane.
+void ConsoleSession::drawOutput(int first, int last)
+{
+    first = std::max(first, 0);
+    last = std::min(last, outputRows() - 1);
+    for (int row = first; row <= last; row++) {
+        term->clearToEol(row, 0);
+    }
+
+    int bottom = outputRows() - 1;
+    for (size_t i = lines.size() - scrollRows; i > 0 && bottom >= first; i--) {
+        const AttrLine& line = lines[i - 1];
+        int top = bottom - lineHeight(line) + 1;
+        if (top <= last) drawLine(line, top, first, last);
+        bottom = top - 1;
+    }
+}
+
+// Scrolls the output pane up by n rows, or down if n is negative, and draws
+// the rows that come into view.
+void ConsoleSession::scrollOutput(int n)
+{
+    int rows = outputRows();
+    if (rows == 0 || n == 0) return;
+
+    if (abs(n) >= rows) {
+        drawOutput(0, rows - 1);
+        return;
+    }
+
+    term->scrollRegion(0, rows - 1, n);
+    if (n > 0) {
+        drawOutput(rows - n, rows - 1);
+    }
+    else {
+        drawOutput(0, -n - 1);
+    }
+}
+
+// Moves the output pane's contents to stay against its bottom edge after it
+// has been resized from oldRows, drawing any rows it has gained at the top.
+void ConsoleSession::resizeOutput(int oldRows)
+{
+    int rows = outputRows();
+    if (rows < oldRows) {
+        term->scrollRegion(0, oldRows - 1, oldRows - rows);
+    }
+    else if (rows > oldRows) {
+        term->scrollRegion(0, rows - 1, oldRows - rows);
+        drawOutput(0, rows - oldRows - 1);
+    }
+}
+
+// While scrolled back the pane keeps showing the same lines.
+void ConsoleSession::appendOutput(const AttrLine& line)
+{
+    lines.push_back(line);
+    if (scrollRows > 0) {
+        scrollRows++;
+    }
+    else {
+        scrollOutput(lineHeight(line));
+    }
+}
+
+void ConsoleSession::drawWatch(int index)
+{
+    int row = outputRows() + index;
+    term->clearToEol(row, 0);
+    drawLine(watchLines[index], row, row, row);
+}
+
+// Draws text starting at column x of the input row, as scrolled by
+// inputOffset. Characters cut by either edge are left out. Returns the
+// column after the text.
+int ConsoleSession::drawInputText(int x, const std::string& text, attr_t attr)
+{
+    int row = inputRow();
+    int cols = term->cols();
+
+    if (::isAscii(text.c_str(), text.size())) {
+        int skip = std::min<int>(std::max<int>((int)inputOffset - x, 0), text.size());
+        int col = x + skip - inputOffset;
+        if (col < cols) term->putText(row, col, text.c_str() + skip, std::min<int>(text.size() - skip, cols - col), attr);
+        return x + text.size();
+    }
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        int width;
+        size_t next = nextCluster(text.c_str(), text.size(), pos, width);
+        int col = x - (int)inputOffset;
+        if (col >= 0 && col + width <= cols) term->putText(row, col, text.c_str() + pos, next - pos, attr);
+        x += width;
+        pos = next;
+    }
+    return x;
+}
+
+// Redraws the input row, scrolled sideways if needed to keep the cursor on
+// the screen.
+void ConsoleSession::drawInput()
+{
+    int row = inputRow();
+    unsigned int cols = term->cols();
+    unsigned int promptWidth = displayWidth(prompt.c_str(), prompt.size());
+    unsigned int cursorCol = promptWidth + displayWidth(pEdit->c_str(), cursorPos);
+
+    int cursorWidth = 1;
+    if (cursorPos < pEdit->size()) nextCluster(pEdit->c_str(), pEdit->size(), cursorPos, cursorWidth);
+
+    if (cursorCol < inputOffset) inputOffset = cursorCol;
+    if (cursorCol + cursorWidth > inputOffset + cols) inputOffset = cursorCol + cursorWidth - cols;
+
+    term->clearToEol(row, 0);
+    drawInputText(0, prompt, COLOR_PAIR(PAIR_BLUE));
+    drawInputText(promptWidth, *pEdit, COLOR_PAIR(PAIR_WHITE));
+
+    term->setHighlight(row, cursorCol - inputOffset, true);
+    term->moveCursor(row, cursorCol - inputOffset);
+}
+
+// All keyboard input goes through here so that it can be recorded or replayed.
+int ConsoleSession::readKey()
+{
+    int c;
+    if (replayer) {
+        // getKey() would have flushed pending output, so include it in the
+        // previous key's handling time.
+        term->flush();
+
+        KeyReplayer::Event event;
+        if (!replayer->nextEvent(event)) return KEY_EOF;
+        c = event.key;
+        if (c == KEY_RESIZE) term->resize(event.rows, event.cols);
+    }
+    else {
+        c = term->getKey();
+    }
+
+    if (recorder && c != ERR) recorder->record(c, term->rows(), term->cols());
+    return c;
 }
 
 void ConsoleSession::replaceEdit(std::string& newEdit)
 {
-    std::string blanks(pEdit->size(), ' ');
-    logical_mvaddstr(cursorRow, prompt.size(), blanks.c_str());
     pEdit = &newEdit;
-    logical_mvaddstr(cursorRow, prompt.size(), pEdit->c_str());
-    cursorCol = prompt.size() + pEdit->size();
-    updateCursor();
+    cursorPos = pEdit->size();
 }
 
 bool ConsoleSession::handleMotion(int c)
 {
-    assert(cursorCol >= prompt.size());
-    size_t pos = cursorCol - prompt.size();
+    assert(cursorPos <= pEdit->size());
+    int width;
 
     switch (c) {
     case KEY_LEFT:
-        if (pos > 0) {
-            cursorCol--;
-            updateCursor();
+        if (cursorPos > 0) {
+            cursorPos = prevCluster(pEdit->c_str(), pEdit->size(), cursorPos);
         }
         return true;
 
     case KEY_RIGHT:
-        if (pos < pEdit->size()) {
-            cursorCol++;
-            updateCursor();
+        if (cursorPos < pEdit->size()) {
+            cursorPos = nextCluster(pEdit->c_str(), pEdit->size(), cursorPos, width);
         }
         return true;
 
     case CTRL_F:
-        scrollTo(scrollRows + 1);
+        if (scrollRows > 0) {
+            scrollRows--;
+            scrollOutput(lineHeight(lines[lines.size() - 1 - scrollRows]));
+            if (snapshot) snapshot->setCursor(lines.size(), cursorPos, scrollRows);
+        }
         return true;
 
     case CTRL_B:
-        if (scrollRows > 0) {
-            scrollTo(scrollRows - 1);
+        if (scrollRows + 1 < lines.size()) {
+            int height = lineHeight(lines[lines.size() - 1 - scrollRows]);
+            scrollRows++;
+            scrollOutput(-height);
+            if (snapshot) snapshot->setCursor(lines.size(), cursorPos, scrollRows);
         }
         return true;
 
@@ -238,17 +473,15 @@ bool ConsoleSession::handleMotion(int c)
 
 bool ConsoleSession::handleEdit(int c)
 {
-    assert(cursorCol >= prompt.size());
-    size_t pos = cursorCol - prompt.size();
+    assert(cursorPos <= pEdit->size());
+    size_t start;
 
     switch (c) {
     case KEY_BACKSPACE:
-        if (pos > 0) {
-            cursorCol--;
-            pEdit->erase(pos - 1, 1);
-            logical_mvaddstr(cursorRow, cursorCol, pEdit->substr(pos - 1).c_str());
-            addch(' ');
-            updateCursor();
+        if (cursorPos > 0) {
+            start = prevCluster(pEdit->c_str(), pEdit->size(), cursorPos);
+            pEdit->erase(start, cursorPos - start);
+            cursorPos = start;
         }
         return true;
 
@@ -276,26 +509,40 @@ bool ConsoleSession::handleEdit(int c)
     }
 }
 
+// Keys arrive a byte at a time, so the bytes of a UTF-8 character are
+// collected until it is complete.
 bool ConsoleSession::handleVisible(int c)
 {
-    if (c < ' ' || c > '~') return false;
+    if (c < ' ' || c == 127 || c > 0xff) return false;
 
-    assert(cursorCol >= prompt.size());
-    size_t pos = cursorCol - prompt.size();
+    assert(cursorPos <= pEdit->size());
 
-    if (pos > pEdit->size()) {
-        *pEdit += c;
+    if (c >= 0x80) {
+        if ((c & 0xc0) != 0x80) partialChar = "";  // a new lead byte
+        else if (partialChar.empty()) return true; // a stray continuation byte
+
+        partialChar += (char)c;
+        size_t length = utf8SequenceLength(partialChar[0]);
+        if (length == 0) {
+            partialChar = "";
+            return true;
+        }
+        if (partialChar.size() < length) return true;
+    }
+    else {
+        partialChar = std::string(1, (char)c);
     }
-    else if (bReplace) {
-        pEdit->replace(pos, 1, 1, c);
+
+    if (bReplace && cursorPos < pEdit->size()) {
+        int width;
+        size_t end = nextCluster(pEdit->c_str(), pEdit->size(), cursorPos, width);
+        pEdit->replace(cursorPos, end - cursorPos, partialChar);
     }
     else {
-        pEdit->insert(pos, 1, c);
-        logical_mvaddstr(cursorRow, cursorCol + 1, pEdit->substr(pos + 1).c_str());
+        pEdit->insert(cursorPos, partialChar);
     }
-    logical_mvaddch(cursorRow, cursorCol, c);
-    cursorCol++;
+    cursorPos += partialChar.size();
+    partialChar = "";
 
     return true;
 }
-
@@ -26,47 +26,93 @@
 #define _CONSOLE_SESSION__H_
 
 #include <cassert>
+#include <signal.h>
 
 #include "dirty_vector.h"
+#include "attr_line.h"
+#include "session_snapshot.h"
+#include "key_recorder.h"
+#include "terminal_backend.h"
 #include <string>
 #include <vector>
-
-#include <curses.h>
+#include <functional>
 
 enum {
     MAP_NONE = 0,
     MAP_WRAP_AROUND
 };
 
+// Called while getLine() waits for a key. Returns the milliseconds until it
+// wants to be called again, or a negative number to wait for the next key.
+typedef std::function<int()> idle_handler_t;
+
+// The screen is split into an output pane, which holds every line put or
+// entered so far, and an input row at the bottom where getLine() edits. New
+// output scrolls the pane with the terminal's own scrolling, so appending a
+// line only paints that line, and editing only repaints the input row. A
+// watch region can be shown between the two.
 class ConsoleSession
 {
 private:
-    // logical coordinates. must be transformed to screen coordinates.
-    unsigned int cursorRow;
-    unsigned int cursorCol;
+    // byte offset of the cursor in the input being edited.
+    size_t cursorPos;
 
+    // how many lines the output pane is scrolled back from the newest.
     unsigned int scrollRows;
 
+    // first column of the input row on the screen, when it is too long to fit.
+    unsigned int inputOffset;
+
+    // bytes of a UTF-8 character typed so far.
+    std::string partialChar;
+
     std::string prompt;
     std::string newLine;
     std::string* pEdit;
 
     int mode;
     bool bReplace;
-    std::vector<std::string> prompts;
-    std::vector<std::string> lines;
+    compressed_vector<AttrLine> lines;
     dirty_vector<std::string> input;
+    std::vector<AttrLine> watchLines;
 
     size_t currentInput;
 
+    SessionSnapshot* snapshot;
+    KeyRecorder* recorder;
+    KeyReplayer* replayer;
+
+    unsigned long repaints;
+
+    TerminalBackend* term;
+    idle_handler_t idleHandler;
+    const volatile sig_atomic_t* pExit;
+
+    bool exitRequested() const { return pExit && *pExit; }
+
 protected:
-    // cursor motion and output operations
-    int logical_move(int row, int col, bool bAutoScroll = true);
-    int logical_mvchgat(int row, int col, int n, attr_t attr, short color, const void* opts, bool bAutoScroll = true);
-    int logical_mvaddch(int row, int col, const chtype c, bool bAutoScroll = true);
-    int logical_mvaddstr(int row, int col, const char* str, bool bAutoScroll = true);
+    // pane geometry
+    int outputRows() const;
+    int watchRows() const;
+    int inputRow() const { return outputRows() + watchRows(); }
+    int lineHeight(const AttrLine& line) const;
+
+    // output pane operations. Pane rows outside first..last are left alone.
+    void drawLine(const AttrLine& line, int top, int first, int last);
+    void drawOutput(int first, int last);
+    void scrollOutput(int n);
+    void appendOutput(const AttrLine& line);
+    void resizeOutput(int oldRows);
+
+    // watch region operations
+    void drawWatch(int index);
+
+    // input row operations
+    int drawInputText(int x, const std::string& text, attr_t attr);
+    void drawInput();
 
     // input and edit operations
+    int readKey();
     void replaceEdit(std::string& newEdit);
     bool handleMotion(int c); // motion keys
     bool handleEdit(int c); // insertion/deletion keys
@@ -77,19 +123,41 @@ public:
     ConsoleSession(const std::string& _prompt = "> ", int _mode = MAP_WRAP_AROUND);
     ~ConsoleSession();
 
-    // screen operations
+    // screen operations. A backend must be set before anything is drawn.
+    void setBackend(TerminalBackend* _term) { term = _term; }
     void update();
-    void scrollTo(unsigned int row) { scrollRows = row; update(); }
-    void autoScroll(unsigned int row);
+    void scrollTo(unsigned int rows); // scrolls the output pane back by rows lines
 
-    // cursor motion and output operations
-    int updateCursor(bool bAutoScroll = true) { return logical_move(cursorRow, cursorCol, bAutoScroll); }
+    // Shows lines in the watch region, which is sized to fit them, up to
+    // half the screen. Lines past the right edge are cut off. Only lines
+    // that differ from those shown are redrawn. Nothing shown there goes
+    // into the scrollback.
+    void setWatch(const std::vector<AttrLine>& region);
+    void clearWatch();
 
     // line operations
+    void setIdleHandler(const idle_handler_t& handler) { idleHandler = handler; }
+    bool hasIdleHandler() const { return (bool)idleHandler; }
     std::string getLine();
-    void putLine(const std::string& line);
 
-    bool isCursorInScreen() const;
+    // Once *flag is set, as by a signal handler, getLine() returns "exit".
+    // The handler should be installed without SA_RESTART so that a blocked
+    // key read returns.
+    void setExitFlag(const volatile sig_atomic_t* flag) { pExit = flag; }
+
+    void putLine(const std::string& line); // may contain newlines and ANSI color escapes
+    void putLine(const AttrLine& line);
+
+    // session persistence
+    void setSnapshot(SessionSnapshot* _snapshot) { snapshot = _snapshot; }
+    void restore(const SessionState& state);
+    void save(SessionState& state) const; // the contents restore() takes
+
+    // key recording and replay. Once a replay runs out of keys, getLine()
+    // returns "exit".
+    void setRecorder(KeyRecorder* _recorder) { recorder = _recorder; }
+    void setReplayer(KeyReplayer* _replayer) { replayer = _replayer; }
+    unsigned long getRepaints() const { return repaints; }
 };
 
 #endif // _CONSOLE_SESSION__H_
@@ -0,0 +1,171 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// curses_backend.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "curses_backend.h"
+#include "attr_line.h"
+#include "utf8.h"
+
+#include <stdlib.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+bool CursesBackend::init()
+{
+    if (out) {
+        const char* term = getenv("TERM");
+        if (!newterm(term ? term : "xterm", out, in)) return false;
+    }
+    else {
+        initscr();      /* initialize the curses library */
+    }
+    keypad(stdscr, TRUE);  /* enable keyboard mapping */
+    idlok(stdscr, TRUE);   /* allow hardware line scrolling */
+    nonl();         /* tell curses not to do NL->CR/NL on output */
+    cbreak();       /* take input chars one at a time, no wait for \n */
+    noecho();
+
+    if (has_colors())
+    {
+        start_color();
+
+        /*
+         * Simple color assignment, often all we need.  Color pair 0 cannot
+     * be redefined.  This example uses the same value for the color
+     * pair as for the foreground color, though of course that is not
+     * necessary:
+         */
+        init_pair(PAIR_RED,     COLOR_RED,     COLOR_BLACK);
+        init_pair(PAIR_GREEN,   COLOR_GREEN,   COLOR_BLACK);
+        init_pair(PAIR_YELLOW,  COLOR_YELLOW,  COLOR_BLACK);
+        init_pair(PAIR_BLUE,    COLOR_BLUE,    COLOR_BLACK);
+        init_pair(PAIR_CYAN,    COLOR_CYAN,    COLOR_BLACK);
+        init_pair(PAIR_MAGENTA, COLOR_MAGENTA, COLOR_BLACK);
+        init_pair(PAIR_WHITE,   COLOR_WHITE,   COLOR_BLACK);
+    }
+    return true;
+}
+
+void CursesBackend::shutdown()
+{
+    endwin();
+}
+
+// erase() rather than clear(), so that refresh() only sends what changed.
+void CursesBackend::clear()
+{
+    erase();
+}
+
+void CursesBackend::clearToEol(int row, int col)
+{
+    if (move(row, col) == ERR) return;
+    attrset(A_NORMAL);
+    clrtoeol();
+}
+
+void CursesBackend::putText(int row, int col, const char* text, size_t length, attr_t attr)
+{
+    if (row < 0 || row >= LINES || col >= COLS) return;
+
+    if (isAscii(text, length)) {
+        if (length > (size_t)(COLS - col)) length = COLS - col;
+    }
+    else {
+        // clip to whole characters that fit
+        size_t pos = 0;
+        int end = col;
+        int width;
+        while (pos < length) {
+            size_t next = nextCluster(text, length, pos, width);
+            if (end + width > COLS) break;
+            end += width;
+            pos = next;
+        }
+        length = pos;
+    }
+
+    attrset(attr);
+    mvaddnstr(row, col, text, length);
+}
+
+void CursesBackend::setHighlight(int row, int col, bool bOn)
+{
+    mvchgat(row, col, 1, bOn ? A_STANDOUT : A_NORMAL, 0, NULL);
+}
+
+void CursesBackend::moveCursor(int row, int col)
+{
+    move(row, col);
+}
+
+void CursesBackend::flush()
+{
+    refresh();
+}
+
+// Scrolling is only enabled for the duration of the call so that writing to
+// the bottom right corner never scrolls the screen.
+void CursesBackend::scrollRegion(int top, int bottom, int n)
+{
+    wsetscrreg(stdscr, top, bottom);
+    scrollok(stdscr, TRUE);
+    wscrl(stdscr, n);
+    scrollok(stdscr, FALSE);
+    wsetscrreg(stdscr, 0, LINES - 1);
+}
+
+int CursesBackend::getKey()
+{
+    int c = getch();
+    if (c == ERR && inputClosed()) return KEY_EOF;
+    return c;
+}
+
+void CursesBackend::setKeyTimeout(int ms)
+{
+    timeout(ms);
+}
+
+void CursesBackend::resize(int rows, int cols)
+{
+    resizeterm(rows, cols);
+}
+
+//
+// Private Methods
+//
+
+// getch() returns ERR both on a timeout and once the input is closed. Input
+// that polls readable with nothing to read has been closed or hung up.
+bool CursesBackend::inputClosed() const
+{
+    struct pollfd pfd;
+    pfd.fd = in ? fileno(in) : 0;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 0) <= 0) return false;
+    if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) return true;
+
+    int n = 0;
+    return ioctl(pfd.fd, FIONREAD, &n) < 0 || n == 0;
+}
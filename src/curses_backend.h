@@ -0,0 +1,63 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// curses_backend.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _CURSES_BACKEND__H_
+#define _CURSES_BACKEND__H_
+
+#include "terminal_backend.h"
+
+#include <stdio.h>
+
+class CursesBackend : public TerminalBackend
+{
+private:
+    FILE* out;
+    FILE* in;
+
+    bool inputClosed() const;
+
+public:
+    // With no streams given, curses runs on the controlling terminal.
+    CursesBackend(FILE* _out = NULL, FILE* _in = NULL) : out(_out), in(_in) { }
+
+    bool init();
+    void shutdown();
+
+    int rows() const { return LINES; }
+    int cols() const { return COLS; }
+
+    void clear();
+    void clearToEol(int row, int col);
+    void putText(int row, int col, const char* text, size_t length, attr_t attr);
+    void setHighlight(int row, int col, bool bOn);
+    void moveCursor(int row, int col);
+    void flush();
+    void scrollRegion(int top, int bottom, int n);
+
+    int getKey();
+    void setKeyTimeout(int ms);
+    void resize(int rows, int cols);
+};
+
+#endif // _CURSES_BACKEND__H_
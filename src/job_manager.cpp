@@ -0,0 +1,227 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// job_manager.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "job_manager.h"
+
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+
+// How often blocked waits check their cancellation token.
+#define WAIT_POLL_MS    50
+
+//
+// Public Methods
+//
+JobManager::JobManager() :
+    state(new State()), nextId(1)
+{
+}
+
+JobManager::~JobManager()
+{
+}
+
+unsigned int JobManager::start(const std::string& description, task_t task, const CancelToken& token)
+{
+    unsigned int id = nextId++;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        Job& job = state->jobs[id];
+        job.id = id;
+        job.description = description;
+        job.state = JOB_RUNNING;
+        job.token = token;
+        job.bReported = false;
+        job.bCollected = false;
+    }
+
+    std::shared_ptr<State> s(state);
+    std::thread worker([s, id, task]() {
+        std::string result;
+        int newState = JOB_DONE;
+        try {
+            result = task();
+        }
+        catch (const std::exception& e) {
+            result = e.what();
+            newState = JOB_FAILED;
+        }
+        catch (...) {
+            result = "Unknown error.";
+            newState = JOB_FAILED;
+        }
+
+        std::lock_guard<std::mutex> lock(s->mutex);
+        std::map<unsigned int, Job>::iterator it = s->jobs.find(id);
+        if (it != s->jobs.end() && it->second.state == JOB_RUNNING) {
+            it->second.state = newState;
+            it->second.result = result;
+        }
+        s->cond.notify_all();
+    });
+    worker.detach();
+
+    return id;
+}
+
+bool JobManager::kill(unsigned int id)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    std::map<unsigned int, Job>::iterator it = state->jobs.find(id);
+    if (it == state->jobs.end()) return false;
+
+    if (it->second.state == JOB_RUNNING) {
+        it->second.token.cancel();
+        it->second.state = JOB_KILLED;
+        it->second.result = "Killed.";
+        state->cond.notify_all();
+    }
+    return true;
+}
+
+bool JobManager::wait(unsigned int id, const CancelToken& waitToken)
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (true) {
+        std::map<unsigned int, Job>::iterator it = state->jobs.find(id);
+        if (it == state->jobs.end()) return false;
+        if (it->second.token == waitToken) throw std::runtime_error("A job cannot wait for itself.");
+        if (it->second.state != JOB_RUNNING || it->second.token.isTimedOut()) {
+            collect(it);
+            return true;
+        }
+        state->cond.wait_for(lock, std::chrono::milliseconds(WAIT_POLL_MS));
+        waitToken.check();
+    }
+}
+
+void JobManager::waitAll(const CancelToken& waitToken)
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (true) {
+        bool bRunning = false;
+        std::map<unsigned int, Job>::iterator it = state->jobs.begin();
+        for (; it != state->jobs.end(); ++it) {
+            if (it->second.state == JOB_RUNNING && !it->second.token.isTimedOut() && !(it->second.token == waitToken)) {
+                bRunning = true;
+                break;
+            }
+        }
+        if (!bRunning) {
+            it = state->jobs.begin();
+            while (it != state->jobs.end()) {
+                if (it->second.token == waitToken) ++it;
+                else collect(it++);
+            }
+            return;
+        }
+        state->cond.wait_for(lock, std::chrono::milliseconds(WAIT_POLL_MS));
+        waitToken.check();
+    }
+}
+
+std::vector<Job> JobManager::list()
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    std::vector<Job> jobs;
+    std::map<unsigned int, Job>::iterator it = state->jobs.begin();
+    while (it != state->jobs.end()) {
+        jobs.push_back(it->second);
+        collect(it++);
+    }
+    return jobs;
+}
+
+std::vector<Job> JobManager::reap()
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    std::vector<Job> finished;
+    std::map<unsigned int, Job>::iterator it = state->jobs.begin();
+    while (it != state->jobs.end()) {
+        if (it->second.state == JOB_RUNNING && it->second.token.isTimedOut()) {
+            try {
+                it->second.token.check();
+            }
+            catch (const std::exception& e) {
+                it->second.result = e.what();
+            }
+            it->second.token.cancel();
+            it->second.state = JOB_FAILED;
+        }
+
+        if (it->second.state != JOB_RUNNING && !it->second.bReported) {
+            finished.push_back(it->second);
+            it->second.bReported = true;
+            it->second.result.clear();
+            if (it->second.bCollected) {
+                state->jobs.erase(it++);
+                continue;
+            }
+        }
+        ++it;
+    }
+    return finished;
+}
+
+//
+// Private Methods
+//
+// Forgets a finished job once it has also been reported. Running jobs are
+// left alone.
+void JobManager::collect(std::map<unsigned int, Job>::iterator it)
+{
+    if (it->second.state == JOB_RUNNING && !it->second.token.isTimedOut()) return;
+    it->second.bCollected = true;
+    if (it->second.bReported) state->jobs.erase(it);
+}
+
+//
+// Parallel Execution
+//
+void parallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+    size_t nThreads = std::thread::hardware_concurrency();
+    if (nThreads == 0) nThreads = 1;
+    if (nThreads > count) nThreads = count;
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < count) {
+            fn(i);
+        }
+    };
+
+    // The calling thread does its share of the work too.
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nThreads; i++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// job_manager.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _JOB_MANAGER__H_
+#define _JOB_MANAGER__H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+
+#include "cancel_token.h"
+
+enum {
+    JOB_RUNNING = 0,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_KILLED
+};
+
+// Snapshot of a job as seen by the interpreter thread.
+struct Job
+{
+    unsigned int id;
+    std::string description;
+    int state;
+    std::string result; // output if JOB_DONE, error message otherwise
+    CancelToken token;
+    bool bReported;     // returned by reap(), which drops the result
+    bool bCollected;    // waited for or listed since it finished
+};
+
+// Runs tasks on worker threads. Workers never touch the console - finished
+// jobs are collected with reap() from the interpreter thread.
+class JobManager
+{
+public:
+    typedef std::function<std::string()> task_t;
+
+    JobManager();
+    ~JobManager();
+
+    // The task should poll token and give up once it is cancelled.
+    unsigned int start(const std::string& description, task_t task, const CancelToken& token);
+
+    // Cancels the job's token and discards its result.
+    bool kill(unsigned int id);
+
+    // A finished job is kept, as shells do, until it has been both reported
+    // by reap() and waited for or listed.
+
+    // Block until the job has finished. Returns false for unknown ids.
+    // Throws if waitToken is cancelled first, or is the job's own token.
+    // waitAll() skips the job waitToken belongs to, if any.
+    bool wait(unsigned int id, const CancelToken& waitToken);
+    void waitAll(const CancelToken& waitToken);
+
+    std::vector<Job> list();
+
+    // Returns all finished jobs not yet reported. Jobs that have outlived
+    // their deadline are reported as failed.
+    std::vector<Job> reap();
+
+private:
+    // Shared with the worker threads so they may outlive the manager.
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::map<unsigned int, Job> jobs;
+    };
+
+    std::shared_ptr<State> state;
+    unsigned int nextId;
+
+    void collect(std::map<unsigned int, Job>::iterator it); // called with mutex held
+};
+
+// Calls fn(0) ... fn(count - 1) spread over all available cores.
+// Blocks until every call has returned.
+void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+#endif // _JOB_MANAGER__H_
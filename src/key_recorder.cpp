@@ -0,0 +1,183 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// key_recorder.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "key_recorder.h"
+
+#include <curses.h>
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+// number of slowest keys listed in the report
+#define REPORT_SLOWEST  10
+
+using namespace std::chrono;
+
+///////////////////////////////////
+//
+// KeyRecorder
+//
+KeyRecorder::KeyRecorder() :
+    file(NULL)
+{
+}
+
+KeyRecorder::~KeyRecorder()
+{
+    close();
+}
+
+void KeyRecorder::open(const std::string& path, int rows, int cols)
+{
+    close();
+
+    file = fopen(path.c_str(), "w");
+    if (!file) {
+        std::stringstream err;
+        err << "Cannot open key log " << path << ": " << strerror(errno);
+        throw std::runtime_error(err.str());
+    }
+
+    start = steady_clock::now();
+    record(KEY_RESIZE, rows, cols);
+}
+
+void KeyRecorder::close()
+{
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+void KeyRecorder::record(int key, int rows, int cols)
+{
+    if (!file) return;
+
+    unsigned long micros = duration_cast<microseconds>(steady_clock::now() - start).count();
+    if (key == KEY_RESIZE) {
+        fprintf(file, "%lu %d %d %d\n", micros, key, rows, cols);
+    }
+    else {
+        fprintf(file, "%lu %d\n", micros, key);
+    }
+
+    // keep the log useful if the session dies
+    fflush(file);
+}
+
+///////////////////////////////////
+//
+// KeyReplayer
+//
+KeyReplayer::KeyReplayer() :
+    next(0), bRealtime(false)
+{
+}
+
+void KeyReplayer::load(const std::string& path)
+{
+    std::ifstream log(path.c_str());
+    if (!log) {
+        std::stringstream err;
+        err << "Cannot open key log " << path << ".";
+        throw std::runtime_error(err.str());
+    }
+
+    events.clear();
+    std::string line;
+    while (std::getline(log, line)) {
+        std::istringstream iss(line);
+        Event event;
+        event.rows = event.cols = 0;
+        if (!(iss >> event.micros >> event.key)) continue;
+        if (event.key == KEY_RESIZE && !(iss >> event.rows >> event.cols)) {
+            std::stringstream err;
+            err << "Resize without a size in key log " << path << ".";
+            throw std::runtime_error(err.str());
+        }
+        events.push_back(event);
+    }
+
+    next = 0;
+    latencies.clear();
+}
+
+bool KeyReplayer::nextEvent(Event& event)
+{
+    steady_clock::time_point now = steady_clock::now();
+    if (next == 0) {
+        start = now;
+    }
+    else {
+        latencies.push_back(duration_cast<microseconds>(now - keyTime).count());
+    }
+
+    if (next == events.size()) return false;
+    event = events[next++];
+
+    if (bRealtime) {
+        std::this_thread::sleep_until(start + microseconds(event.micros));
+    }
+    keyTime = steady_clock::now();
+    return true;
+}
+
+std::string KeyReplayer::report() const
+{
+    std::stringstream out;
+    out << "Keys replayed: " << latencies.size() << std::endl;
+    if (latencies.empty()) return out.str();
+
+    std::vector<unsigned long> sorted(latencies);
+    std::sort(sorted.begin(), sorted.end());
+
+    unsigned long total = 0;
+    for (size_t i = 0; i < sorted.size(); i++) total += sorted[i];
+
+    out << "Handling latency (us):"
+        << " mean " << total / sorted.size()
+        << " p50 " << sorted[sorted.size() / 2]
+        << " p90 " << sorted[sorted.size() * 9 / 10]
+        << " p99 " << sorted[sorted.size() * 99 / 100]
+        << " max " << sorted.back() << std::endl;
+    out << "Total handling time (us): " << total << std::endl;
+
+    std::vector<size_t> order(latencies.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return latencies[a] > latencies[b];
+    });
+
+    out << "Slowest keys (index, key code, us):";
+    for (size_t i = 0; i < order.size() && i < REPORT_SLOWEST; i++) {
+        out << std::endl << "  " << order[i] << " " << events[order[i]].key << " " << latencies[order[i]];
+    }
+    return out.str();
+}
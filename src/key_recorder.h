@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// key_recorder.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _KEY_RECORDER__H_
+#define _KEY_RECORDER__H_
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+// Key logs are text, one key per line:
+//
+//   <microseconds since start> <key code> [<rows> <cols>]
+//
+// Resize events carry the new screen size. The first line of a log is
+// always a resize giving the size the session started with.
+class KeyRecorder
+{
+private:
+    FILE* file;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    KeyRecorder();
+    ~KeyRecorder();
+
+    void open(const std::string& path, int rows, int cols);
+    void close();
+
+    void record(int key, int rows, int cols);
+};
+
+class KeyReplayer
+{
+public:
+    struct Event
+    {
+        unsigned long micros;
+        int key;
+        int rows;
+        int cols;
+    };
+
+private:
+    std::vector<Event> events;
+    size_t next;
+    bool bRealtime;
+
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point keyTime;
+
+    // handling time of each replayed key, in microseconds
+    std::vector<unsigned long> latencies;
+
+public:
+    KeyReplayer();
+
+    void load(const std::string& path);
+    void setRealtime(bool _bRealtime) { bRealtime = _bRealtime; }
+
+    // Returns the next event, waiting for its original time if replaying in
+    // real time. The time since the previous call is taken as the handling
+    // latency of the previous key. Returns false when no keys remain.
+    bool nextEvent(Event& event);
+
+    std::string report() const;
+};
+
+#endif // _KEY_RECORDER__H_
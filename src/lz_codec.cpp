@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// lz_codec.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "lz_codec.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#define MIN_MATCH       4
+#define MAX_OFFSET      65535
+#define HASH_BITS       12
+
+static inline uint32_t read32(const char* p)
+{
+    uint32_t n;
+    memcpy(&n, p, sizeof(n));
+    return n;
+}
+
+static inline uint32_t hash32(uint32_t n)
+{
+    return (n * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Writes the part of a length that does not fit in its nibble.
+static void putLength(std::string& out, size_t length)
+{
+    for (; length >= 255; length -= 255) out += (char)255;
+    out += (char)length;
+}
+
+static void putSequence(std::string& out, const char* literals, size_t nLiterals, size_t offset, size_t matchLength)
+{
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+    unsigned char token = (nLiterals < 15 ? nLiterals : 15) << 4 | (matchCode < 15 ? matchCode : 15);
+    out += (char)token;
+    if (nLiterals >= 15) putLength(out, nLiterals - 15);
+    out.append(literals, nLiterals);
+
+    if (matchLength == 0) return;
+    out += (char)(offset & 0xff);
+    out += (char)(offset >> 8);
+    if (matchCode >= 15) putLength(out, matchCode - 15);
+}
+
+std::string lzCompress(const std::string& data)
+{
+    const char* src = data.data();
+    size_t size = data.size();
+
+    std::string out;
+    out.reserve(size / 2 + 16);
+    uint32_t n = size;
+    out.append((const char*)&n, sizeof(n));
+
+    std::vector<int> table(1 << HASH_BITS, -1);
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + MIN_MATCH <= size) {
+        uint32_t h = hash32(read32(src + pos));
+        int candidate = table[h];
+        table[h] = pos;
+
+        if (candidate < 0 || pos - candidate > MAX_OFFSET || read32(src + candidate) != read32(src + pos)) {
+            pos++;
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while (pos + length < size && src[candidate + length] == src[pos + length]) length++;
+
+        putSequence(out, src + anchor, pos - anchor, pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    putSequence(out, src + anchor, size - anchor, 0, 0);
+    return out;
+}
+
+std::string lzDecompress(const char* block, size_t blockSize)
+{
+    const unsigned char* in = (const unsigned char*)block;
+    const unsigned char* end = in + blockSize;
+    if (blockSize < sizeof(uint32_t)) throw std::runtime_error("Corrupt compressed block.");
+
+    uint32_t size = read32(block);
+    in += sizeof(size);
+
+    // no sequence expands by more than 255 times, so a corrupt size cannot
+    // reserve much
+    std::string out;
+    out.reserve(std::min<size_t>(size, blockSize * 255));
+    while (in < end) {
+        unsigned char token = *in++;
+
+        size_t nLiterals = token >> 4;
+        if (nLiterals == 15) {
+            unsigned char b;
+            do {
+                if (in == end) throw std::runtime_error("Corrupt compressed block.");
+                b = *in++;
+                nLiterals += b;
+            } while (b == 255);
+        }
+        if ((size_t)(end - in) < nLiterals) throw std::runtime_error("Corrupt compressed block.");
+        out.append((const char*)in, nLiterals);
+        in += nLiterals;
+
+        if (in == end) break;
+
+        if (end - in < 2) throw std::runtime_error("Corrupt compressed block.");
+        size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+
+        size_t length = (token & 0x0f);
+        if (length == 15) {
+            unsigned char b;
+            do {
+                if (in == end) throw std::runtime_error("Corrupt compressed block.");
+                b = *in++;
+                length += b;
+            } while (b == 255);
+        }
+        length += MIN_MATCH;
+
+        if (offset == 0 || offset > out.size() || out.size() + length > size) {
+            throw std::runtime_error("Corrupt compressed block.");
+        }
+
+        // matches may overlap what they copy
+        size_t from = out.size() - offset;
+        for (size_t i = 0; i < length; i++) {
+            out += out[from + i];
+        }
+    }
+
+    if (out.size() != size) throw std::runtime_error("Corrupt compressed block.");
+    return out;
+}
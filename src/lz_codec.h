@@ -0,0 +1,47 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// lz_codec.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _LZ_CODEC__H_
+#define _LZ_CODEC__H_
+
+#include <stddef.h>
+
+#include <string>
+
+// A small LZ77 codec in the style of LZ4, tuned for speed over ratio. It
+// does well on repetitive text such as logs and tables.
+//
+// A block is the uncompressed size as a 32 bit integer followed by
+// sequences. Each sequence is a token byte holding the literal count in its
+// high nibble and the match length less 4 in its low nibble, then the
+// literals, then a 16 bit match offset. A nibble of 15 continues in the
+// bytes that follow, each adding up to 255. The last sequence has literals
+// only.
+std::string lzCompress(const std::string& data);
+
+// Throws std::runtime_error if the block is malformed.
+std::string lzDecompress(const char* block, size_t size);
+inline std::string lzDecompress(const std::string& block) { return lzDecompress(block.data(), block.size()); }
+
+#endif // _LZ_CODEC__H_
@@ -0,0 +1,138 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// machine_session.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "machine_session.h"
+
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include <stdexcept>
+
+#define READ_CHUNK      65536
+#define FLUSH_THRESHOLD 65536
+
+//
+// Public Methods
+//
+MachineSession::MachineSession(int _inFd, int _outFd) :
+    inFd(_inFd), outFd(_outFd), inPos(0)
+{
+}
+
+MachineSession::~MachineSession()
+{
+    flush();
+}
+
+bool MachineSession::getRequest(std::string& request)
+{
+    // parse the header. fill() may move the unread input, so positions are
+    // kept relative to inPos.
+    size_t length = 0;
+    size_t headerSize = 0;
+    while (true) {
+        if (inPos + headerSize == inBuf.size()) {
+            if (!fill()) {
+                if (headerSize == 0) return false;
+                throw std::runtime_error("Truncated frame header.");
+            }
+            continue;
+        }
+
+        char c = inBuf[inPos + headerSize++];
+        if (c == '\n') break;
+        if (c < '0' || c > '9' || headerSize > 10) {
+            throw std::runtime_error("Malformed frame header.");
+        }
+        length = length * 10 + (c - '0');
+    }
+    if (headerSize == 1) throw std::runtime_error("Malformed frame header.");
+    if (length > MACHINE_MAX_FRAME) throw std::runtime_error("Frame too large.");
+
+    // wait for the payload
+    while (inBuf.size() - inPos - headerSize < length) {
+        if (!fill()) throw std::runtime_error("Truncated frame.");
+    }
+
+    request.assign(inBuf, inPos + headerSize, length);
+    inPos += headerSize + length;
+    return true;
+}
+
+void MachineSession::putResponse(int status, unsigned int index, unsigned long micros, const std::string& payload)
+{
+    char header[64];
+    int n = snprintf(header, sizeof(header), "%lu %d %u %lu\n", (unsigned long)payload.size(), status, index, micros);
+    outBuf.append(header, n);
+    outBuf += payload;
+
+    if (outBuf.size() >= FLUSH_THRESHOLD) flush();
+}
+
+bool MachineSession::flush()
+{
+    size_t written = 0;
+    while (written < outBuf.size()) {
+        ssize_t n = write(outFd, outBuf.data() + written, outBuf.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            outBuf.clear();
+            return false;
+        }
+        written += n;
+    }
+    outBuf.clear();
+    return true;
+}
+
+//
+// Private Methods
+//
+
+// Reads more input. Pending responses are flushed first unless more input
+// is already waiting, since otherwise the peer may be blocked on them.
+bool MachineSession::fill()
+{
+    struct pollfd pfd;
+    pfd.fd = inFd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 0) <= 0) flush();
+
+    // drop consumed frames
+    if (inPos > 0) {
+        inBuf.erase(0, inPos);
+        inPos = 0;
+    }
+
+    char buf[READ_CHUNK];
+    while (true) {
+        ssize_t n = read(inFd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        inBuf.append(buf, n);
+        return true;
+    }
+}
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// machine_session.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _MACHINE_SESSION__H_
+#define _MACHINE_SESSION__H_
+
+#include <string>
+
+// Frame format, all headers in ASCII decimal:
+//
+//   request:   <length>\n<command line>
+//   response:  <length> <status> <history index> <microseconds>\n<payload>
+//
+// The history index is the N of %N for the result, or 0 on error.
+enum {
+    MACHINE_OK = 0,
+    MACHINE_ERROR,
+    MACHINE_BAD_FRAME
+};
+
+#define MACHINE_MAX_FRAME   (64 * 1024 * 1024)
+
+// Reads framed requests and writes framed responses over a pair of file
+// descriptors. Responses are buffered and only flushed when the next
+// request has not fully arrived yet, so pipelined requests are answered
+// without a write per command.
+class MachineSession
+{
+private:
+    int inFd;
+    int outFd;
+
+    std::string inBuf;
+    size_t inPos;
+    std::string outBuf;
+
+    bool fill();
+
+public:
+    MachineSession(int _inFd, int _outFd);
+    ~MachineSession();
+
+    // Returns false at end of input. Throws std::runtime_error on a
+    // malformed frame, after which the stream cannot be resynchronized.
+    bool getRequest(std::string& request);
+    void putResponse(int status, unsigned int index, unsigned long micros, const std::string& payload);
+
+    bool flush();
+};
+
+#endif // _MACHINE_SESSION__H_
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// module_loader.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "module_loader.h"
+
+#include <dlfcn.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+//
+// Public Methods
+//
+void ModuleLoader::loadManifest(const std::string& manifestPath)
+{
+    std::ifstream manifest(manifestPath.c_str());
+    if (!manifest) {
+        std::stringstream err;
+        err << "Cannot open module manifest " << manifestPath << ".";
+        throw std::runtime_error(err.str());
+    }
+
+    std::string dir;
+    size_t slash = manifestPath.rfind('/');
+    if (slash != std::string::npos) dir = manifestPath.substr(0, slash + 1);
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+        std::istringstream iss(line);
+        std::string path;
+        if (!(iss >> path) || path[0] == '#') continue;
+
+        Module module;
+        module.path = (path[0] == '/') ? path : dir + path;
+        module.handle = NULL;
+        modules.push_back(module);
+
+        std::string command;
+        while (iss >> command) {
+            commands[command] = modules.size() - 1;
+        }
+    }
+}
+
+void ModuleLoader::clear()
+{
+    modules.clear();
+    commands.clear();
+}
+
+std::string ModuleLoader::moduleFor(const std::string& command) const
+{
+    std::map<std::string, size_t>::const_iterator it = commands.find(command);
+    if (it == commands.end()) return "";
+    return modules[it->second].path;
+}
+
+std::vector<std::string> ModuleLoader::pendingCommands() const
+{
+    std::vector<std::string> pending;
+    std::map<std::string, size_t>::const_iterator it = commands.begin();
+    for (; it != commands.end(); ++it) {
+        if (!modules[it->second].handle) pending.push_back(it->first);
+    }
+    return pending;
+}
+
+bool ModuleLoader::load(const std::string& command)
+{
+    std::map<std::string, size_t>::iterator it = commands.find(command);
+    if (it == commands.end()) return false;
+
+    Module& module = modules[it->second];
+    if (module.handle) return true;
+
+    void* handle = dlopen(module.path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        std::stringstream err;
+        err << "Cannot load module " << module.path << ": " << dlerror();
+        throw std::runtime_error(err.str());
+    }
+
+    fInitModule init = (fInitModule)dlsym(handle, MODULE_INIT_SYMBOL);
+    if (!init) {
+        std::stringstream err;
+        err << "Module " << module.path << " has no " << MODULE_INIT_SYMBOL << " function.";
+        dlclose(handle);
+        throw std::runtime_error(err.str());
+    }
+
+    module.handle = handle;
+    init();
+    return true;
+}
@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// module_loader.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _MODULE_LOADER__H_
+#define _MODULE_LOADER__H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+// Name of the function every module exports with C linkage. It registers
+// the module's commands with addCommand().
+#define MODULE_INIT_SYMBOL  "initModule"
+
+typedef void (*fInitModule)();
+
+// Keeps track of which shared object provides which command, as declared in
+// manifest files, and loads each module the first time one of its commands
+// is needed.
+//
+// Manifest lines have the form
+//
+//   <module path> <command> [<command> ...]
+//
+// Relative module paths are resolved against the manifest's directory.
+// Blank lines and lines starting with # are ignored.
+class ModuleLoader
+{
+private:
+    struct Module
+    {
+        std::string path;
+        void* handle;
+    };
+
+    std::vector<Module> modules;
+    std::map<std::string, size_t> commands; // command name -> module index
+
+public:
+    ModuleLoader() { }
+    ~ModuleLoader() { }
+
+    void loadManifest(const std::string& manifestPath);
+
+    // Forgets every manifest. Modules already loaded are not closed, as
+    // their code may still be running, but are initialized again the next
+    // time one of their commands is loaded.
+    void clear();
+
+    // Returns the path of the module providing command, or "" if none does.
+    std::string moduleFor(const std::string& command) const;
+
+    // Commands declared by modules that have not been loaded yet.
+    std::vector<std::string> pendingCommands() const;
+
+    // Loads the module providing command. Returns false if no module
+    // declares it, and throws if the module cannot be loaded.
+    bool load(const std::string& command);
+};
+
+#endif // _MODULE_LOADER__H_
@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// example_module.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+// Example of a command module. Build with "make modules" and point
+// CONSOLESHELL_MODULES at example.manifest.
+
+#include "../command_interpreter.h"
+
+#include <algorithm>
+
+result_t example_reverse(bool bHelp, const params_t& params)
+{
+    if (bHelp || params.size() == 0) {
+        return "reverse <arg1> [<arg2> ...] - repeats the arguments to output, backwards.";
+    }
+
+    std::string result = params[0];
+    for (auto it = params.begin() + 1; it != params.end(); ++it) {
+        result += " ";
+        result += *it;
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+extern "C" void initModule()
+{
+    addCommand("reverse", &example_reverse);
+}
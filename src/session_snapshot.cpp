@@ -0,0 +1,439 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// session_snapshot.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "session_snapshot.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+
+#define SNAPSHOT_MAGIC      "CSSNAP01"
+#define SNAPSHOT_FLUSH_MS   250
+#define SNAPSHOT_WRITE_BATCH 65536
+
+struct snapshot_header
+{
+    char magic[8];
+    uint64_t dataEnd;   // file offset just past the last complete record
+    uint32_t cursorRow;
+    uint32_t cursorCol;
+    uint32_t scrollRows;
+    uint32_t reserved;
+};
+
+// Payloads use the same codecs as compressed blocks, so a line is stored
+// alike in both.
+static void putRecord(std::string& buf, int type, const std::string& payload)
+{
+    buf += (char)type;
+    block_codec<std::string>::putUint32(buf, payload.size());
+    buf += payload;
+}
+
+template <typename T>
+static std::string encodePayload(const T& value)
+{
+    std::string data;
+    block_codec<T>::encode(value, data);
+    return data;
+}
+
+// The element count, so that a block sealed with another block size is
+// refused, then the block as compressed.
+template <typename T>
+static std::string blockPayload(const compressed_vector<T>& values, size_t n)
+{
+    size_t size;
+    const char* block = values.sealedBlock(n, size);
+    std::string data;
+    block_codec<std::string>::putUint32(data, values.blockLength());
+    data.append(block, size);
+    return data;
+}
+
+static bool writeAll(int fd, const std::string& data)
+{
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        written += n;
+    }
+    return true;
+}
+
+// Writes records to a new file in batches, leaving room for the header.
+class RecordWriter
+{
+private:
+    int fd;
+    std::string data;
+    uint64_t offset;
+    bool bOk;
+
+public:
+    RecordWriter(int _fd) : fd(_fd), data(sizeof(snapshot_header), '\0'), offset(0), bOk(true) { }
+
+    void put(int type, const std::string& payload)
+    {
+        putRecord(data, type, payload);
+        if (data.size() >= SNAPSHOT_WRITE_BATCH) flush();
+    }
+
+    bool flush()
+    {
+        bOk = bOk && writeAll(fd, data);
+        offset += data.size();
+        data.clear();
+        return bOk;
+    }
+
+    uint64_t dataEnd() const { return offset + data.size(); }
+};
+
+// Sealed blocks are not copied or decoded, only pointed to in the mapping.
+template <typename T>
+static void adoptBlock(const char* pos, const char* end, compressed_vector<T>& values)
+{
+    uint32_t count = block_codec<std::string>::getUint32(pos, end);
+    if (count != values.blockLength() || !values.adoptSealed(pos, end - pos)) {
+        throw std::runtime_error("Corrupt session snapshot.");
+    }
+}
+
+static void decodeRecord(int type, const char* data, size_t size, SessionState& state)
+{
+    const char* pos = data;
+    const char* end = data + size;
+    try {
+        switch (type) {
+        case SNAPSHOT_LINE:
+            state.lines.push_back(block_codec<AttrLine>::decode(pos, end));
+            break;
+
+        case SNAPSHOT_INPUT:
+            state.input.push_back(block_codec<std::string>::decode(pos, end));
+            break;
+
+        case SNAPSHOT_INPUT_HISTORY:
+            state.inputHistory.push_back(block_codec<std::string>::decode(pos, end));
+            break;
+
+        case SNAPSHOT_OUTPUT_HISTORY:
+            state.outputHistory.push_back(block_codec<std::string>::decode(pos, end));
+            break;
+
+        case SNAPSHOT_LINE_BLOCK:
+            adoptBlock(pos, end, state.lines);
+            break;
+
+        case SNAPSHOT_OUTPUT_HISTORY_BLOCK:
+            adoptBlock(pos, end, state.outputHistory);
+            break;
+
+        default:
+            // records from a newer version are skipped
+            break;
+        }
+    }
+    catch (const std::runtime_error&) {
+        throw std::runtime_error("Corrupt session snapshot.");
+    }
+}
+
+//
+// Public Methods
+//
+SessionSnapshot::SessionSnapshot() :
+    fd(-1), dataEnd(sizeof(snapshot_header)), map(NULL), mapSize(0), cursorRow(0), cursorCol(0), scrollRows(0), bDirty(false), bStop(false)
+{
+}
+
+SessionSnapshot::~SessionSnapshot()
+{
+    close();
+    if (map) munmap(map, mapSize);
+}
+
+void SessionSnapshot::open(const std::string& _path, SessionState& state)
+{
+    close();
+    if (map) throw std::runtime_error("Session snapshot already opened.");
+    path = _path;
+
+    int newFd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (newFd < 0) {
+        std::stringstream err;
+        err << "Cannot open session snapshot " << path << ": " << strerror(errno);
+        throw std::runtime_error(err.str());
+    }
+
+    struct stat st;
+    if (fstat(newFd, &st) < 0) {
+        ::close(newFd);
+        throw std::runtime_error(strerror(errno));
+    }
+
+    snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.dataEnd = sizeof(header);
+
+    if (st.st_size > 0) {
+        void* mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, newFd, 0);
+        if (mapped == MAP_FAILED) {
+            ::close(newFd);
+            throw std::runtime_error(strerror(errno));
+        }
+
+        try {
+            const char* base = (const char*)mapped;
+            if ((size_t)st.st_size < sizeof(header) || memcmp(base, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+                throw std::runtime_error("Not a session snapshot.");
+            }
+            memcpy(&header, base, sizeof(header));
+            if (header.dataEnd < sizeof(header) || header.dataEnd > (uint64_t)st.st_size) {
+                throw std::runtime_error("Corrupt session snapshot.");
+            }
+
+            uint64_t pos = sizeof(header);
+            while (pos < header.dataEnd) {
+                if (header.dataEnd - pos < 5) throw std::runtime_error("Corrupt session snapshot.");
+                int type = (unsigned char)base[pos];
+                uint32_t size;
+                memcpy(&size, base + pos + 1, sizeof(size));
+                pos += 5;
+                if (header.dataEnd - pos < size) throw std::runtime_error("Corrupt session snapshot.");
+
+                decodeRecord(type, base + pos, size, state);
+                pos += size;
+            }
+        }
+        catch (...) {
+            munmap(mapped, st.st_size);
+            ::close(newFd);
+            throw;
+        }
+        map = mapped;
+        mapSize = st.st_size;
+
+        state.cursorRow = header.cursorRow;
+        state.cursorCol = header.cursorCol;
+        state.scrollRows = header.scrollRows;
+    }
+
+    // anything past dataEnd was never committed
+    if (ftruncate(newFd, header.dataEnd) < 0 || lseek(newFd, header.dataEnd, SEEK_SET) < 0) {
+        ::close(newFd);
+        throw std::runtime_error(strerror(errno));
+    }
+
+    fd = newFd;
+    dataEnd = header.dataEnd;
+    cursorRow = header.cursorRow;
+    cursorCol = header.cursorCol;
+    scrollRows = header.scrollRows;
+    writeHeader();
+
+    bStop = false;
+    bDirty = false;
+    writer = std::thread(&SessionSnapshot::writerLoop, this);
+}
+
+void SessionSnapshot::close()
+{
+    if (fd < 0) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bStop = true;
+        cond.notify_all();
+    }
+    writer.join();
+
+    ::close(fd);
+    fd = -1;
+}
+
+// The copy is written next to the journal and renamed over it, so a failure
+// at any point leaves one or the other intact. Blocks restored by open() are
+// still read from the old file's mapping, which outlives the rename.
+void SessionSnapshot::close(const SessionState& state)
+{
+    if (fd < 0) return;
+    close();
+
+    std::string tmpPath = path + ".tmp";
+    int newFd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (newFd < 0) {
+        std::stringstream err;
+        err << "Cannot write session snapshot " << tmpPath << ": " << strerror(errno);
+        throw std::runtime_error(err.str());
+    }
+
+    RecordWriter writer(newFd);
+
+    size_t first = state.lines.sealedBlocks() * state.lines.blockLength();
+    for (size_t i = 0; i < state.lines.sealedBlocks(); i++) {
+        writer.put(SNAPSHOT_LINE_BLOCK, blockPayload(state.lines, i));
+    }
+    for (size_t i = first; i < state.lines.size(); i++) {
+        writer.put(SNAPSHOT_LINE, encodePayload(state.lines[i]));
+    }
+    for (size_t i = 0; i < state.input.size(); i++) {
+        writer.put(SNAPSHOT_INPUT, encodePayload(state.input[i]));
+    }
+    for (size_t i = 0; i < state.inputHistory.size(); i++) {
+        writer.put(SNAPSHOT_INPUT_HISTORY, encodePayload(state.inputHistory[i]));
+    }
+
+    first = state.outputHistory.sealedBlocks() * state.outputHistory.blockLength();
+    for (size_t i = 0; i < state.outputHistory.sealedBlocks(); i++) {
+        writer.put(SNAPSHOT_OUTPUT_HISTORY_BLOCK, blockPayload(state.outputHistory, i));
+    }
+    for (size_t i = first; i < state.outputHistory.size(); i++) {
+        writer.put(SNAPSHOT_OUTPUT_HISTORY, encodePayload(state.outputHistory[i]));
+    }
+    bool bOk = writer.flush();
+
+    snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.dataEnd = writer.dataEnd();
+    header.cursorRow = cursorRow;
+    header.cursorCol = cursorCol;
+    header.scrollRows = scrollRows;
+    bOk = bOk && pwrite(newFd, &header, sizeof(header), 0) == sizeof(header) && fsync(newFd) == 0;
+
+    int error = errno;
+    ::close(newFd);
+    if (!bOk || rename(tmpPath.c_str(), path.c_str()) < 0) {
+        if (bOk) error = errno;
+        unlink(tmpPath.c_str());
+        std::stringstream err;
+        err << "Cannot write session snapshot " << tmpPath << ": " << strerror(error);
+        throw std::runtime_error(err.str());
+    }
+}
+
+void SessionSnapshot::appendLine(const AttrLine& line)
+{
+    append(SNAPSHOT_LINE, encodePayload(line));
+}
+
+void SessionSnapshot::appendInput(const std::string& input)
+{
+    append(SNAPSHOT_INPUT, encodePayload(input));
+}
+
+void SessionSnapshot::appendInputHistory(const std::string& input)
+{
+    append(SNAPSHOT_INPUT_HISTORY, encodePayload(input));
+}
+
+void SessionSnapshot::appendOutputHistory(const std::string& output)
+{
+    append(SNAPSHOT_OUTPUT_HISTORY, encodePayload(output));
+}
+
+void SessionSnapshot::setCursor(uint32_t row, uint32_t col, uint32_t scroll)
+{
+    if (fd < 0) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    cursorRow = row;
+    cursorCol = col;
+    scrollRows = scroll;
+    bDirty = true;
+}
+
+//
+// Private Methods
+//
+void SessionSnapshot::append(int type, const std::string& payload)
+{
+    if (fd < 0) return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    putRecord(pending, type, payload);
+    bDirty = true;
+}
+
+void SessionSnapshot::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (!bStop) cond.wait_for(lock, std::chrono::milliseconds(SNAPSHOT_FLUSH_MS));
+        bool bStopping = bStop;
+
+        if (bDirty) {
+            std::string data;
+            data.swap(pending);
+            bDirty = false;
+            lock.unlock();
+
+            size_t written = 0;
+            while (written < data.size()) {
+                ssize_t n = write(fd, data.data() + written, data.size() - written);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                written += n;
+            }
+
+            lock.lock();
+            if (written == data.size()) {
+                dataEnd += written;
+            }
+            else {
+                // drop the partial records rather than leave a hole
+                lseek(fd, dataEnd, SEEK_SET);
+            }
+            writeHeader();
+        }
+
+        if (bStopping) return;
+    }
+}
+
+// Called with mutex held.
+void SessionSnapshot::writeHeader()
+{
+    snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.dataEnd = dataEnd;
+    header.cursorRow = cursorRow;
+    header.cursorCol = cursorCol;
+    header.scrollRows = scrollRows;
+    ssize_t rc = pwrite(fd, &header, sizeof(header), 0);
+    (void)rc;
+}
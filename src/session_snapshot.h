@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// session_snapshot.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _SESSION_SNAPSHOT__H_
+#define _SESSION_SNAPSHOT__H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "attr_line.h"
+
+enum {
+    SNAPSHOT_LINE = 1,              // ConsoleSession scrollback line
+    SNAPSHOT_INPUT,                 // ConsoleSession edit history
+    SNAPSHOT_INPUT_HISTORY,         // interpreter input history
+    SNAPSHOT_OUTPUT_HISTORY,        // interpreter output history, for %N
+    SNAPSHOT_LINE_BLOCK,            // sealed block of scrollback lines
+    SNAPSHOT_OUTPUT_HISTORY_BLOCK   // sealed block of output history
+};
+
+// Everything needed to bring a session back after a restart.
+struct SessionState
+{
+    SessionState() : cursorRow(0), cursorCol(0), scrollRows(0) { }
+
+    compressed_vector<AttrLine> lines;
+    std::vector<std::string> input;
+    std::vector<std::string> inputHistory;
+    compressed_vector<std::string> outputHistory;
+
+    uint32_t cursorRow;
+    uint32_t cursorCol;
+    uint32_t scrollRows;
+};
+
+// Append-only session journal. The file is a fixed header holding the cursor
+// position and the length of valid data, followed by records of the form
+//
+//   <uint8 type> <uint32 length> <payload>
+//
+// Appends are queued and written by a background thread, which rewrites
+// the header only after the records it covers. A crash loses at most the
+// records queued since the last write. Integers are in host byte order.
+//
+// Closing with the session state rewrites the file to hold just that state,
+// with the sealed blocks of the scrollback and output history stored as they
+// are in memory. Opening adopts those blocks straight from the mapping, so
+// only the records since the last such close are decoded.
+class SessionSnapshot
+{
+private:
+    int fd;
+    uint64_t dataEnd;
+    std::string path;
+
+    // kept until destruction, as restored blocks point into it
+    void* map;
+    size_t mapSize;
+
+    std::string pending;
+    uint32_t cursorRow;
+    uint32_t cursorCol;
+    uint32_t scrollRows;
+    bool bDirty;
+    bool bStop;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread writer;
+
+    void append(int type, const std::string& payload);
+    void writerLoop();
+    void writeHeader();
+
+public:
+    SessionSnapshot();
+    ~SessionSnapshot(); // flushes pending records
+
+    // Maps the file at path, restores its contents into state and starts
+    // appending to it. A missing file starts a new, empty session. Throws
+    // if the file cannot be opened or is not a valid snapshot. Only one
+    // file can be opened per snapshot.
+    void open(const std::string& _path, SessionState& state);
+    bool isOpen() const { return fd >= 0; }
+
+    void close();
+
+    // Closes the journal and replaces it with a compact copy of state.
+    // Throws if the copy cannot be written, leaving the journal as it was.
+    void close(const SessionState& state);
+
+    void appendLine(const AttrLine& line);
+    void appendInput(const std::string& input);
+    void appendInputHistory(const std::string& input);
+    void appendOutputHistory(const std::string& output);
+    void setCursor(uint32_t row, uint32_t col, uint32_t scroll);
+};
+
+#endif // _SESSION_SNAPSHOT__H_
@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// terminal_backend.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _TERMINAL_BACKEND__H_
+#define _TERMINAL_BACKEND__H_
+
+#include <stddef.h>
+
+// Only for the attr_t type, the A_* attributes and the KEY_* codes, which
+// every backend shares.
+#include <curses.h>
+
+// Returned by getKey() once input has ended, and by ConsoleSession::readKey()
+// once a replay has run out of keys.
+#define KEY_EOF     (-2)
+
+// Everything ConsoleSession needs from a terminal. Coordinates are screen
+// coordinates. Text never wraps - anything past the right edge or outside
+// the screen is dropped.
+class TerminalBackend
+{
+public:
+    virtual ~TerminalBackend() { }
+
+    virtual bool init() = 0;
+    virtual void shutdown() = 0;
+
+    virtual int rows() const = 0;
+    virtual int cols() const = 0;
+
+    // drawing
+    virtual void clear() = 0;
+    virtual void clearToEol(int row, int col) = 0;
+    virtual void putText(int row, int col, const char* text, size_t length, attr_t attr) = 0;
+    virtual void setHighlight(int row, int col, bool bOn) = 0; // marks the cursor cell
+    virtual void moveCursor(int row, int col) = 0;
+    virtual void flush() = 0;
+
+    // Scrolls rows top to bottom (inclusive) up by n rows, or down if n is
+    // negative. The rows scrolled in are blank. The terminal is made to move
+    // the rest itself, so they are not redrawn.
+    virtual void scrollRegion(int top, int bottom, int n) = 0;
+
+    // input. Returns a character or one of the curses KEY_* codes, ERR if
+    // interrupted by a signal or no key came within the timeout, or KEY_EOF
+    // if the input has ended. Pending output is flushed first.
+    virtual int getKey() = 0;
+    virtual void setKeyTimeout(int ms) = 0; // negative waits forever
+
+    // Sets the screen size, as if the terminal had been resized.
+    virtual void resize(int rows, int cols) = 0;
+};
+
+#endif // _TERMINAL_BACKEND__H_
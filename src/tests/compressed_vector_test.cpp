@@ -0,0 +1,93 @@
+#include "../compressed_vector.h"
+#include "../attr_line.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+int main()
+{
+    compressed_vector<std::string> cv(8, 2);
+    for (int i = 0; i < 100; i++) {
+        std::stringstream line;
+        line << "line " << i << ": the quick brown fox jumps over the lazy dog";
+        cv.push_back(line.str());
+    }
+
+    std::cout << "Size: " << cv.size() << std::endl;
+    std::cout << "Back: " << cv.back() << std::endl;
+
+    std::cout << "Read back." << std::endl;
+    for (int i = 0; i < cv.size(); i++) {
+        std::stringstream line;
+        line << "line " << i << ": the quick brown fox jumps over the lazy dog";
+        if (cv[i] != line.str()) {
+            std::cout << "Mismatch at " << i << ": " << cv[i] << std::endl;
+            return 1;
+        }
+    }
+    std::cout << cv[0] << std::endl;
+    std::cout << cv[57] << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "Compressed bytes: " << cv.compressedBytes() << std::endl;
+
+    std::cout << "Corrupt a block." << std::endl;
+    size_t size;
+    const char* block = cv.sealedBlock(3, size);
+    std::string corrupt(block, size);
+    corrupt[size / 2] ^= 0x5a;
+    std::string truncated(block, size - 3);
+
+    const std::string* bad[] = { &corrupt, &truncated };
+    for (int i = 0; i < 2; i++) {
+        compressed_vector<std::string> adopted(8, 2);
+        try {
+            adopted.adoptSealed(bad[i]->data(), bad[i]->size());
+            std::string value = adopted[0];
+            std::cout << "Decoded anyway: " << value << std::endl;
+            return 1;
+        }
+        catch (const std::runtime_error& e) {
+            std::cout << "Refused: " << e.what() << std::endl;
+        }
+    }
+    std::cout << std::endl;
+
+    cv.clear();
+    std::cout << "Cleared, size: " << cv.size() << std::endl;
+    std::cout << std::endl;
+
+    std::cout << "Attributed lines." << std::endl;
+    compressed_vector<AttrLine> lines(4, 1);
+    for (int i = 0; i < 10; i++) {
+        AttrLine line("plain ", A_NORMAL);
+        line.append("bold", A_BOLD).append(" and ", A_NORMAL).append("\xc3\xa9t\xc3\xa9", A_UNDERLINE);
+        lines.push_back(line);
+    }
+    for (int i = 0; i < lines.size(); i++) {
+        if (lines[i] != lines[lines.size() - 1]) {
+            std::cout << "Mismatch at " << i << ": " << lines[i].text() << std::endl;
+            return 1;
+        }
+    }
+    const AttrLine& first = lines[0];
+    std::cout << first.text() << " - " << first.spans().size() << " spans, width " << first.width() << std::endl;
+
+    // a span running past the end of the text
+    std::string data;
+    block_codec<std::string>::encode("short", data);
+    block_codec<std::string>::putUint32(data, 1);
+    block_codec<std::string>::putUint32(data, 2);
+    block_codec<std::string>::putUint32(data, 0xffffffff);
+    block_codec<std::string>::putUint32(data, A_NORMAL);
+    const char* pos = data.data();
+    try {
+        block_codec<AttrLine>::decode(pos, data.data() + data.size());
+        std::cout << "Decoded a bad span." << std::endl;
+        return 1;
+    }
+    catch (const std::runtime_error& e) {
+        std::cout << "Refused: " << e.what() << std::endl;
+    }
+    return 0;
+}
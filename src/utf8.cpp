@@ -0,0 +1,239 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// utf8.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "utf8.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct char_range
+{
+    uint32_t first;
+    uint32_t last;
+};
+
+// Zero width characters: combining marks, joiners and variation selectors.
+static const char_range zeroWidth[] = {
+    { 0x0300, 0x036f }, { 0x0483, 0x0489 }, { 0x0591, 0x05bd }, { 0x05bf, 0x05bf },
+    { 0x05c1, 0x05c2 }, { 0x05c4, 0x05c5 }, { 0x05c7, 0x05c7 }, { 0x0610, 0x061a },
+    { 0x064b, 0x065f }, { 0x0670, 0x0670 }, { 0x06d6, 0x06dc }, { 0x06df, 0x06e4 },
+    { 0x06e7, 0x06e8 }, { 0x06ea, 0x06ed }, { 0x0711, 0x0711 }, { 0x0730, 0x074a },
+    { 0x07a6, 0x07b0 }, { 0x07eb, 0x07f3 }, { 0x0816, 0x0819 }, { 0x081b, 0x0823 },
+    { 0x0825, 0x0827 }, { 0x0829, 0x082d }, { 0x0859, 0x085b }, { 0x08d3, 0x08e1 },
+    { 0x08e3, 0x0902 }, { 0x093a, 0x093a }, { 0x093c, 0x093c }, { 0x0941, 0x0948 },
+    { 0x094d, 0x094d }, { 0x0951, 0x0957 }, { 0x0962, 0x0963 }, { 0x0981, 0x0981 },
+    { 0x09bc, 0x09bc }, { 0x09c1, 0x09c4 }, { 0x09cd, 0x09cd }, { 0x09e2, 0x09e3 },
+    { 0x0a01, 0x0a02 }, { 0x0a3c, 0x0a3c }, { 0x0a41, 0x0a51 }, { 0x0a70, 0x0a71 },
+    { 0x0a81, 0x0a82 }, { 0x0abc, 0x0abc }, { 0x0ac1, 0x0ac8 }, { 0x0acd, 0x0acd },
+    { 0x0b01, 0x0b01 }, { 0x0b3c, 0x0b3c }, { 0x0b3f, 0x0b3f }, { 0x0b41, 0x0b44 },
+    { 0x0b4d, 0x0b4d }, { 0x0bc0, 0x0bc0 }, { 0x0bcd, 0x0bcd }, { 0x0c3e, 0x0c40 },
+    { 0x0c46, 0x0c56 }, { 0x0cbc, 0x0cbc }, { 0x0ccc, 0x0ccd }, { 0x0d41, 0x0d44 },
+    { 0x0d4d, 0x0d4d }, { 0x0dca, 0x0dca }, { 0x0dd2, 0x0dd6 }, { 0x0e31, 0x0e31 },
+    { 0x0e34, 0x0e3a }, { 0x0e47, 0x0e4e }, { 0x0eb1, 0x0eb1 }, { 0x0eb4, 0x0ebc },
+    { 0x0ec8, 0x0ecd }, { 0x0f18, 0x0f19 }, { 0x0f35, 0x0f35 }, { 0x0f37, 0x0f37 },
+    { 0x0f39, 0x0f39 }, { 0x0f71, 0x0f7e }, { 0x0f80, 0x0f84 }, { 0x0f86, 0x0f87 },
+    { 0x0f8d, 0x0fbc }, { 0x0fc6, 0x0fc6 }, { 0x102d, 0x1030 }, { 0x1032, 0x1037 },
+    { 0x1039, 0x103a }, { 0x103d, 0x103e }, { 0x1058, 0x1059 }, { 0x1160, 0x11ff },
+    { 0x135d, 0x135f }, { 0x1712, 0x1714 }, { 0x1732, 0x1734 }, { 0x1752, 0x1753 },
+    { 0x1772, 0x1773 }, { 0x17b4, 0x17b5 }, { 0x17b7, 0x17bd }, { 0x17c6, 0x17c6 },
+    { 0x17c9, 0x17d3 }, { 0x17dd, 0x17dd }, { 0x180b, 0x180e }, { 0x18a9, 0x18a9 },
+    { 0x1920, 0x1922 }, { 0x1927, 0x1928 }, { 0x1932, 0x1932 }, { 0x1939, 0x193b },
+    { 0x1a17, 0x1a18 }, { 0x1a56, 0x1a56 }, { 0x1a58, 0x1a7f }, { 0x1ab0, 0x1aff },
+    { 0x1b00, 0x1b03 }, { 0x1b34, 0x1b34 }, { 0x1b36, 0x1b3a }, { 0x1b6b, 0x1b73 },
+    { 0x1dc0, 0x1dff }, { 0x200b, 0x200f }, { 0x202a, 0x202e }, { 0x2060, 0x2064 },
+    { 0x20d0, 0x20f0 }, { 0x2cef, 0x2cf1 }, { 0x2de0, 0x2dff }, { 0x302a, 0x302d },
+    { 0x3099, 0x309a }, { 0xa66f, 0xa672 }, { 0xa674, 0xa67d }, { 0xa69e, 0xa69f },
+    { 0xa6f0, 0xa6f1 }, { 0xa8e0, 0xa8f1 }, { 0xfb1e, 0xfb1e }, { 0xfe00, 0xfe0f },
+    { 0xfe20, 0xfe2f }, { 0xfeff, 0xfeff }, { 0x1d167, 0x1d169 }, { 0x1d17b, 0x1d182 },
+    { 0x1f3fb, 0x1f3ff }, { 0xe0001, 0xe007f }, { 0xe0100, 0xe01ef }
+};
+
+// East Asian wide and fullwidth characters, and emoji presented as wide.
+static const char_range doubleWidth[] = {
+    { 0x1100, 0x115f }, { 0x231a, 0x231b }, { 0x2329, 0x232a }, { 0x23e9, 0x23ec },
+    { 0x23f0, 0x23f0 }, { 0x23f3, 0x23f3 }, { 0x25fd, 0x25fe }, { 0x2614, 0x2615 },
+    { 0x2648, 0x2653 }, { 0x267f, 0x267f }, { 0x2693, 0x2693 }, { 0x26a1, 0x26a1 },
+    { 0x26aa, 0x26ab }, { 0x26bd, 0x26be }, { 0x26c4, 0x26c5 }, { 0x26ce, 0x26ce },
+    { 0x26d4, 0x26d4 }, { 0x26ea, 0x26ea }, { 0x26f2, 0x26f3 }, { 0x26f5, 0x26f5 },
+    { 0x26fa, 0x26fa }, { 0x26fd, 0x26fd }, { 0x2705, 0x2705 }, { 0x270a, 0x270b },
+    { 0x2728, 0x2728 }, { 0x274c, 0x274c }, { 0x274e, 0x274e }, { 0x2753, 0x2755 },
+    { 0x2757, 0x2757 }, { 0x2795, 0x2797 }, { 0x27b0, 0x27b0 }, { 0x27bf, 0x27bf },
+    { 0x2b1b, 0x2b1c }, { 0x2b50, 0x2b50 }, { 0x2b55, 0x2b55 }, { 0x2e80, 0x303e },
+    { 0x3041, 0x3247 }, { 0x3250, 0x4dbf }, { 0x4e00, 0xa4cf }, { 0xa960, 0xa97f },
+    { 0xac00, 0xd7a3 }, { 0xf900, 0xfaff }, { 0xfe10, 0xfe19 }, { 0xfe30, 0xfe6f },
+    { 0xff00, 0xff60 }, { 0xffe0, 0xffe6 }, { 0x16fe0, 0x16fe4 }, { 0x17000, 0x18cff },
+    { 0x1b000, 0x1b2ff }, { 0x1f004, 0x1f004 }, { 0x1f0cf, 0x1f0cf }, { 0x1f18e, 0x1f18e },
+    { 0x1f191, 0x1f19a }, { 0x1f200, 0x1f251 }, { 0x1f300, 0x1f320 }, { 0x1f32d, 0x1f335 },
+    { 0x1f337, 0x1f37c }, { 0x1f37e, 0x1f393 }, { 0x1f3a0, 0x1f3ca }, { 0x1f3cf, 0x1f3d3 },
+    { 0x1f3e0, 0x1f3f0 }, { 0x1f3f4, 0x1f3f4 }, { 0x1f3f8, 0x1f43e }, { 0x1f440, 0x1f440 },
+    { 0x1f442, 0x1f4fc }, { 0x1f4ff, 0x1f53d }, { 0x1f54b, 0x1f54e }, { 0x1f550, 0x1f567 },
+    { 0x1f57a, 0x1f57a }, { 0x1f595, 0x1f596 }, { 0x1f5a4, 0x1f5a4 }, { 0x1f5fb, 0x1f64f },
+    { 0x1f680, 0x1f6c5 }, { 0x1f6cc, 0x1f6cc }, { 0x1f6d0, 0x1f6d2 }, { 0x1f6d5, 0x1f6d7 },
+    { 0x1f6eb, 0x1f6ec }, { 0x1f6f4, 0x1f6fc }, { 0x1f7e0, 0x1f7eb }, { 0x1f90c, 0x1f93a },
+    { 0x1f93c, 0x1f945 }, { 0x1f947, 0x1f9ff }, { 0x1fa70, 0x1faff }, { 0x20000, 0x2fffd },
+    { 0x30000, 0x3fffd }
+};
+
+static bool inRanges(uint32_t c, const char_range* ranges, size_t count)
+{
+    if (c < ranges[0].first || c > ranges[count - 1].last) return false;
+
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (c > ranges[mid].last) {
+            low = mid + 1;
+        }
+        else if (c < ranges[mid].first) {
+            high = mid;
+        }
+        else {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool isAscii(const char* text, size_t length)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(text + i));
+        if (_mm_movemask_epi8(chunk)) return false;
+    }
+#endif
+    for (; i + 8 <= length; i += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, text + i, sizeof(chunk));
+        if (chunk & 0x8080808080808080ULL) return false;
+    }
+    for (; i < length; i++) {
+        if (text[i] & 0x80) return false;
+    }
+    return true;
+}
+
+size_t utf8SequenceLength(unsigned char lead)
+{
+    if (lead < 0x80) return 1;
+    if (lead < 0xc2) return 0;
+    if (lead < 0xe0) return 2;
+    if (lead < 0xf0) return 3;
+    if (lead < 0xf5) return 4;
+    return 0;
+}
+
+uint32_t decodeUtf8(const char* text, size_t length, size_t& pos)
+{
+    unsigned char lead = text[pos];
+    size_t n = utf8SequenceLength(lead);
+    if (n == 1) {
+        pos++;
+        return lead;
+    }
+    if (n == 0 || pos + n > length) {
+        pos++;
+        return UTF8_REPLACEMENT;
+    }
+
+    uint32_t c = lead & (0x7f >> n);
+    for (size_t i = 1; i < n; i++) {
+        unsigned char next = text[pos + i];
+        if ((next & 0xc0) != 0x80) {
+            pos++;
+            return UTF8_REPLACEMENT;
+        }
+        c = (c << 6) | (next & 0x3f);
+    }
+
+    // overlong encodings and surrogates
+    static const uint32_t minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+    if (c < minimum[n] || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+        pos++;
+        return UTF8_REPLACEMENT;
+    }
+
+    pos += n;
+    return c;
+}
+
+// Controls also have no width, but start a cluster of their own.
+static bool isCombining(uint32_t c)
+{
+    return c >= 0x300 && charWidth(c) == 0;
+}
+
+int charWidth(uint32_t c)
+{
+    if (c < 0x20 || (c >= 0x7f && c < 0xa0)) return 0;
+    if (c < 0x300) return 1;
+    if (inRanges(c, zeroWidth, sizeof(zeroWidth) / sizeof(zeroWidth[0]))) return 0;
+    if (inRanges(c, doubleWidth, sizeof(doubleWidth) / sizeof(doubleWidth[0]))) return 2;
+    return 1;
+}
+
+size_t displayWidth(const char* text, size_t length)
+{
+    if (isAscii(text, length)) return length;
+
+    size_t width = 0;
+    size_t pos = 0;
+    while (pos < length) {
+        width += charWidth(decodeUtf8(text, length, pos));
+    }
+    return width;
+}
+
+size_t nextCluster(const char* text, size_t length, size_t pos, int& width)
+{
+    width = charWidth(decodeUtf8(text, length, pos));
+    while (pos < length && (text[pos] & 0x80)) {
+        size_t next = pos;
+        if (!isCombining(decodeUtf8(text, length, next))) break;
+        pos = next;
+    }
+    return pos;
+}
+
+size_t prevCluster(const char* text, size_t length, size_t pos)
+{
+    while (pos > 0) {
+        // back up to the start of the previous character
+        size_t start = pos - 1;
+        while (start > 0 && (text[start] & 0xc0) == 0x80 && pos - start < 4) start--;
+
+        size_t end = start;
+        uint32_t c = decodeUtf8(text, length, end);
+        if (end != pos) return pos - 1; // malformed, which decodes a byte at a time
+
+        pos = start;
+        if (!isCombining(c)) break;
+    }
+    return pos;
+}
@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// utf8.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _UTF8__H_
+#define _UTF8__H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UTF8_REPLACEMENT    0xfffd
+
+// True if none of the bytes have the high bit set. Checks 16 bytes at a time
+// where SSE2 is available, 8 otherwise.
+bool isAscii(const char* text, size_t length);
+
+// Length of the sequence a lead byte starts, or 0 for a continuation or
+// invalid byte.
+size_t utf8SequenceLength(unsigned char lead);
+
+// Decodes the character at pos and advances pos past it. Malformed input
+// decodes as UTF8_REPLACEMENT one byte at a time.
+uint32_t decodeUtf8(const char* text, size_t length, size_t& pos);
+
+// Columns a character takes: 0 for NUL and other control characters,
+// combining marks and other zero width characters, 2 for East Asian wide and
+// fullwidth characters, 1 otherwise. Unlike wcwidth() it does not depend on
+// the locale.
+int charWidth(uint32_t c);
+
+// Columns taken by text. Pure ASCII text is measured by its length.
+size_t displayWidth(const char* text, size_t length);
+
+// A cluster is a character together with any zero width characters that
+// follow it, drawn in the same cell. Returns the end of the cluster starting
+// at pos and sets width to its columns.
+size_t nextCluster(const char* text, size_t length, size_t pos, int& width);
+
+// Returns the start of the cluster ending at pos.
+size_t prevCluster(const char* text, size_t length, size_t pos);
+
+#endif // _UTF8__H_
@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// watcher.cpp
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "watcher.h"
+
+#include <thread>
+
+// How often poll() should be called while a run is in progress.
+#define WATCH_POLL_MS   50
+
+//
+// Public Methods
+//
+Watcher::Watcher() :
+    state(new State())
+{
+}
+
+Watcher::~Watcher()
+{
+    stop();
+}
+
+void Watcher::start(const std::string& description, unsigned long intervalMs, unsigned long timeoutMs, task_t task)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->bRunning) state->token.cancel();
+
+    state->bActive = true;
+    state->generation++;
+    state->description = description;
+    state->intervalMs = intervalMs;
+    state->timeoutMs = timeoutMs;
+    state->task = task;
+    state->bRunning = false;
+    state->bFinished = false;
+    state->due = clock::now();
+}
+
+void Watcher::stop()
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->bRunning) state->token.cancel();
+
+    state->bActive = false;
+    state->generation++;
+    state->task = task_t();
+    state->bRunning = false;
+    state->bFinished = false;
+}
+
+bool Watcher::isActive() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->bActive;
+}
+
+std::string Watcher::description() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->description;
+}
+
+unsigned long Watcher::interval() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->intervalMs;
+}
+
+bool Watcher::poll(std::string& output, bool& bError)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (!state->bActive) return false;
+
+    if (state->bFinished) {
+        state->bFinished = false;
+        output = state->result;
+        bError = state->bError;
+        return true;
+    }
+
+    // a run that ignores its deadline is abandoned
+    if (state->bRunning && state->token.isTimedOut()) {
+        state->generation++;
+        state->bRunning = false;
+        try {
+            state->token.check();
+        }
+        catch (const std::exception& e) {
+            output = e.what();
+        }
+        bError = true;
+        return true;
+    }
+
+    // an abandoned or cancelled run still holds its thread
+    if (state->bRunning || state->bWorkerAlive || clock::now() < state->due) return false;
+
+    // the next run is timed from the start of this one
+    state->bRunning = true;
+    state->bWorkerAlive = true;
+    state->due = clock::now() + std::chrono::milliseconds(state->intervalMs);
+    state->token = CancelToken();
+    state->token.setTimeout(state->timeoutMs);
+
+    std::shared_ptr<State> s(state);
+    unsigned int generation = state->generation;
+    task_t task = state->task;
+    CancelToken token = state->token;
+    std::thread([s, generation, task, token]() {
+        std::string result;
+        bool bError = false;
+        try {
+            result = task(token);
+            token.check();
+        }
+        catch (const std::exception& e) {
+            result = e.what();
+            bError = true;
+        }
+        catch (...) {
+            result = "Unknown error.";
+            bError = true;
+        }
+
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->bWorkerAlive = false;
+        if (s->generation != generation) return;
+        s->bRunning = false;
+        s->bFinished = true;
+        s->bError = bError;
+        s->result = result;
+    }).detach();
+    return false;
+}
+
+int Watcher::nextPollMs() const
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (!state->bActive) return -1;
+    if (state->bRunning || state->bWorkerAlive) return WATCH_POLL_MS;
+    if (state->bFinished) return 0;
+
+    long ms = std::chrono::duration_cast<std::chrono::milliseconds>(state->due - clock::now()).count();
+    return ms > 0 ? ms : 0;
+}
@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// watcher.h
+//
+// Copyright (c) 2013 Eric Lombrozo
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _WATCHER__H_
+#define _WATCHER__H_
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <chrono>
+
+#include "cancel_token.h"
+
+// Reruns a task on a timer for the watch command. Runs happen on worker
+// threads, never two at once, even when a run is abandoned for ignoring its
+// deadline. The interpreter thread picks up their output
+// with poll(), which is also what starts each run, so nothing runs unless
+// the interpreter is polling.
+class Watcher
+{
+public:
+    typedef std::function<std::string(const CancelToken&)> task_t;
+
+    Watcher();
+    ~Watcher();
+
+    // Replaces whatever was being watched. The first run is due at once.
+    // A timeoutMs of 0 lets runs take as long as they like.
+    void start(const std::string& description, unsigned long intervalMs, unsigned long timeoutMs, task_t task);
+
+    // Cancels the run in progress, if any.
+    void stop();
+
+    bool isActive() const;
+    std::string description() const;
+    unsigned long interval() const;
+
+    // Starts a run if one is due. Returns true once a run has finished,
+    // with its output, or its error message and bError set.
+    bool poll(std::string& output, bool& bError);
+
+    // Milliseconds until poll() next has something to do, or -1 if nothing
+    // is being watched.
+    int nextPollMs() const;
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    // Shared with the worker threads so they may outlive the watcher.
+    struct State
+    {
+        std::mutex mutex;
+        bool bActive;
+        unsigned int generation; // bumped on every start() and stop()
+        std::string description;
+        unsigned long intervalMs;
+        unsigned long timeoutMs;
+        task_t task;
+
+        bool bRunning;
+        bool bWorkerAlive; // until the last worker returns, even if abandoned
+        bool bFinished;
+        bool bError;
+        std::string result;
+        CancelToken token;
+        clock::time_point due;
+
+        State() : bActive(false), generation(0), intervalMs(0), timeoutMs(0), bRunning(false), bWorkerAlive(false), bFinished(false), bError(false) { }
+    };
+
+    std::shared_ptr<State> state;
+};
+
+#endif // _WATCHER__H_